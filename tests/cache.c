@@ -0,0 +1,148 @@
+/* Check ultragetopt_cache_parse() against parsing a copy of argv
+ *
+ * Each argv is parsed through the cache (twice, so the second parse comes
+ * from the cache) and directly.  The option indexes and the permutation
+ * reported by the cache must give back what the direct parse returned, also
+ * when argv holds the same pointer more than once.
+ *
+ * This program is part of ultragetopt, see COPYING for licensing details
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ultragetopt.h"
+
+#define MAXARGS	8	/* Most elements of each argv */
+
+static const struct option longopts[] = {
+    { "output", required_argument, NULL, 'o' },
+    { "verbose", no_argument, NULL, 'v' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Check the parse of argv through cache against parsing it directly
+ * Returns 0 if they agree, 1 if not
+ */
+static int check_argv(struct ultragetopt_cache *cache,
+		      const struct ultragetopt_table *table, const char *name,
+		      int argc, char **argv)
+{
+    const struct ultragetopt_parse *parse = NULL;
+    struct ultragetopt_state state;
+    char *work[MAXARGS + 1];
+    int seen[MAXARGS];
+    int pass, i, c;
+
+    for (pass=0; pass<2; pass++) {
+	parse = ultragetopt_cache_parse(cache, argc, argv, table, "=", "-",
+					UGO_OPTIONPERMUTE);
+	if (parse == NULL) {
+	    printf("%s: out of memory\n", name);
+	    return 1;
+	}
+    }
+
+    /* order must be a permutation of argv matching the direct parse */
+    memcpy(work, argv, sizeof(work[0]) * (argc + 1));
+    ultragetopt_state_init(&state);
+    i = 0;
+    while ((c = ultragetopt_tunable_r(&state, argc, work, table, NULL, "=",
+				      "-", UGO_OPTIONPERMUTE)) != -1) {
+	const struct ultragetopt_parsed *parsed = &parse->parsed[i];
+	char *arg;
+
+	if (i >= parse->nparsed || parsed->opt != c
+	    || parsed->index != parse->order[state.curind]) {
+	    printf("%s: option %d differs\n", name, i);
+	    return 1;
+	}
+
+	arg = parsed->argindex >= 0
+	    ? argv[parsed->argindex] + parsed->argoffset : NULL;
+	if (arg != state.optarg) {
+	    printf("%s: argument of option %d differs\n", name, i);
+	    return 1;
+	}
+	i++;
+    }
+    if (i != parse->nparsed || state.optind != parse->optind
+	|| parse->argc != argc) {
+	printf("%s: options or optind differ\n", name);
+	return 1;
+    }
+
+    memset(seen, 0, sizeof(seen));
+    for (i=0; i<argc; i++) {
+	int j = parse->order[i];
+
+	if (j < 0 || j >= argc || seen[j]++ || argv[j] != work[i]) {
+	    printf("%s: order[%d] is %d\n", name, i, j);
+	    return 1;
+	}
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    static char prog[] = "prog", x[] = "x", v[] = "-v", vv[] = "-vv";
+    static char output[] = "--output", f[] = "f", ofile[] = "-ofile";
+    static char verbose[] = "--verbose", term[] = "--";
+    static struct {
+	const char *name;
+	char *argv[MAXARGS + 1];
+    } cases[] = {
+	{ "repeated non-option",
+	  { prog, x, v, x, output, f, NULL } },
+	{ "repeated option",
+	  { prog, v, x, v, v, NULL } },
+	{ "repeated argument",
+	  { prog, x, output, x, f, output, x, NULL } },
+	{ "repeated adjacent argument",
+	  { prog, ofile, x, ofile, f, ofile, NULL } },
+	{ "repeated cluster and terminator",
+	  { prog, vv, f, vv, verbose, term, vv, f, NULL } }
+    };
+    static char *nullargv[] = { prog, v, NULL, x, NULL };
+    struct ultragetopt_cache *cache;
+    struct ultragetopt_table table;
+    int failures = 0;
+    size_t i;
+
+    cache = ultragetopt_cache_create(4);
+    if (cache == NULL) {
+	printf("out of memory\n");
+	return EXIT_FAILURE;
+    }
+
+    memset(&table, 0, sizeof(table));
+    table.shortopts = "o:v";
+    table.longopts = longopts;
+    table.nlongopts = 2;
+    for (i=0; i<sizeof(cases)/sizeof(cases[0]); i++) {
+	int argc = 0;
+
+	while (cases[i].argv[argc] != NULL)
+	    argc++;
+	failures += check_argv(cache, &table, cases[i].name, argc,
+			       cases[i].argv);
+    }
+
+    /* argvs which only differ in argc, after a NULL element */
+    failures += check_argv(cache, &table, "NULL element, argc 4", 4,
+			   nullargv);
+    failures += check_argv(cache, &table, "NULL element, argc 3", 3,
+			   nullargv);
+
+    ultragetopt_cache_free(cache);
+
+    if (failures > 0) {
+	printf("%d argvs parsed differently\n", failures);
+	return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
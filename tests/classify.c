@@ -0,0 +1,132 @@
+/* Check parsing with classes from ultragetopt_classify() against parsing
+ * without them
+ *
+ * Built with CLASSIFY_MINCHUNK lowered, so that small argvs are split into
+ * parts classified by separate threads.  Each argv is parsed with and
+ * without its classes, and the options returned, their arguments, optind,
+ * and the permuted argv must be the same.
+ *
+ * This program is part of ultragetopt, see COPYING for licensing details
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ultragetopt.h"
+
+#define NARGVS	500	/* Random argvs parsed */
+#define MAXARGS	64	/* Most elements of each argv */
+
+static const struct option longopts[] = {
+    { "out", required_argument, NULL, 'o' },
+    { "verbose", no_argument, NULL, 'v' },
+    { NULL, 0, NULL, 0 }
+};
+
+static unsigned long seed = 1;
+
+/* Deterministic pseudo-random number in [0, n) */
+static int rnd(int n)
+{
+    seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return (int)((seed >> 8) % (unsigned long)n);
+}
+
+/* Parse argv (which is permuted), recording everything returned in out
+ * classes - classes of argv, or NULL
+ * Returns the number of entries recorded
+ */
+static int parse(int argc, char **argv, struct ultragetopt_classes *classes,
+		 long *out)
+{
+    struct ultragetopt_state state;
+    int n = 0;
+    int c;
+
+    ultragetopt_state_init(&state);
+    state.opterr = 0;
+    state.classes = classes;
+    do {
+	c = ultragetopt_long_r(&state, argc, argv, "vo:", longopts, NULL);
+	out[n++] = c;
+	out[n++] = state.optarg != NULL ? (long)(state.optarg - argv[0]) : -1;
+	out[n++] = state.optind;
+    } while (c != -1 && n < 3 * 2 * MAXARGS);
+
+    return n;
+}
+
+/* Parse argv with and without classes made by nthreads threads
+ * Returns 0 if the results are the same, 1 if not
+ */
+static int check_argv(const char *name, int argc, char **argv, int nthreads)
+{
+    struct ultragetopt_classes *classes;
+    char *argv1[MAXARGS + 1], *argv2[MAXARGS + 1];
+    long out1[3 * 2 * MAXARGS], out2[3 * 2 * MAXARGS];
+    int n1, n2;
+
+    memcpy(argv1, argv, sizeof(argv[0]) * (argc + 1));
+    memcpy(argv2, argv, sizeof(argv[0]) * (argc + 1));
+
+    classes = ultragetopt_classify(argc, argv2, "-", nthreads);
+    if (classes == NULL) {
+	printf("%s: out of memory\n", name);
+	return 1;
+    }
+
+    n1 = parse(argc, argv1, NULL, out1);
+    n2 = parse(argc, argv2, classes, out2);
+    ultragetopt_classes_free(classes);
+
+    if (n1 != n2 || memcmp(out1, out2, n1 * sizeof(long)) != 0
+	|| memcmp(argv1, argv2, sizeof(argv1[0]) * argc) != 0) {
+	printf("%s (%d threads) differs\n", name, nthreads);
+	return 1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    /* Offsets of optarg are taken from argv[0], so it holds everything */
+    static char text[] =
+	"prog\0-v\0-o\0-ofile\0--out\0--out=f\0--verbose\0-vo\0x\0y\0--\0-";
+    static const int offsets[] = {
+	5, 8, 11, 18, 24, 32, 42, 46, 48, 50, 53
+    };
+    char *argv[MAXARGS + 1];
+    int failures = 0;
+    int i, j;
+
+    /* Operands with an option taking a separate argument at the end of each
+     * part, so that its argument starts the next part:  with 4 threads the
+     * 40 elements after argv[0] are split at argv[11], [21], and [31] */
+    argv[0] = text;
+    for (i=1; i<=40; i++)
+	argv[i] = text + 46;			/* "x" */
+    argv[10] = text + 8;			/* "-o" */
+    argv[20] = text + 18;			/* "--out" */
+    argv[30] = text + 8;			/* "-o" */
+    argv[31] = text + 11;			/* "-ofile" */
+    argv[41] = NULL;
+    failures += check_argv("separate arguments across parts", 41, argv, 4);
+
+    for (i=0; i<NARGVS; i++) {
+	int argc = 1 + rnd(MAXARGS);
+
+	for (j=1; j<argc; j++)
+	    argv[j] = text + offsets[rnd(sizeof(offsets)/sizeof(offsets[0]))];
+	argv[argc] = NULL;
+	failures += check_argv("random argv", argc, argv, 1 + rnd(8));
+    }
+
+    if (failures > 0) {
+	printf("%d argvs parsed differently\n", failures);
+	return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
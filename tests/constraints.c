@@ -0,0 +1,206 @@
+/* Check the constraints compiled by ultragetopt_constraints_create()
+ *
+ * Each kind of constraint is checked on argvs which meet it and argvs which
+ * violate it, each violating no more than one constraint.  A short option
+ * and the long option it is the val of must count as one option, whichever
+ * is given and whichever is named in the constraint.
+ *
+ * This program is part of ultragetopt, see COPYING for licensing details
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ultragetopt.h"
+
+#define NMANY	70	/* Long options in the table needing several words */
+
+static const struct option longopts[] = {
+    { "quiet", no_argument, NULL, 'q' },
+    { "verbose", no_argument, NULL, 'v' },
+    { "input", required_argument, NULL, 'i' },
+    { "output", required_argument, NULL, 0 },
+    { "json", no_argument, NULL, 0 },
+    { "xml", no_argument, NULL, 0 },
+    { "text", no_argument, NULL, 0 },
+    { NULL, 0, NULL, 0 }
+};
+
+static const struct ultragetopt_constraint constraints[] = {
+    { UGO_CONFLICT, "quiet v" },
+    { UGO_REQUIRE, "output i f" },
+    { UGO_ONEOF, "json xml text" },
+    { UGO_ANYOF, "input f" },
+    { 0, NULL }
+};
+
+/* Parse argv to the end, checking constraints
+ * Returns 0 if the result is expected ('?' or -1), 1 if not
+ */
+static int check_argv(struct ultragetopt_constraints *compiled,
+		      const char *shortopts, const struct option *opts,
+		      char **argv, int expected)
+{
+    struct ultragetopt_state state;
+    int argc = 0;
+    int c;
+
+    while (argv[argc] != NULL)
+	argc++;
+
+    ultragetopt_constraints_reset(compiled);
+    ultragetopt_state_init(&state);
+    state.opterr = 0;
+    state.constraints = compiled;
+    do {
+	c = ultragetopt_long_r(&state, argc, argv, shortopts, opts, NULL);
+    } while (c != -1 && c != '?');
+
+    /* A violation is returned once, then parsing ends */
+    if (c == '?')
+	c = ultragetopt_long_r(&state, argc, argv, shortopts, opts, NULL) == -1
+	    ? '?' : 0;
+
+    if (c != expected) {
+	int i;
+
+	printf("%s expected:", expected == -1 ? "met" : "violated");
+	for (i=1; i<argc; i++)
+	    printf(" %s", argv[i]);
+	printf("\n");
+	return 1;
+    }
+
+    return 0;
+}
+
+/* Check constraints spanning several unsigned longs of bitset
+ * Returns the number of failures
+ */
+static int check_many(void)
+{
+    static const struct ultragetopt_constraint many[] = {
+	{ UGO_CONFLICT, "o0 o69" },
+	{ UGO_REQUIRE, "z o65" },
+	{ 0, NULL }
+    };
+    static char names[NMANY][4];
+    static struct option opts[NMANY + 1];
+    struct ultragetopt_constraints *compiled;
+    char *conflict[] = { "prog", "--o0", "--o69", NULL };
+    char *require[] = { "prog", "-z", "--o64", NULL };
+    char *met[] = { "prog", "--o69", "-z", "--o65", NULL };
+    int failures = 0;
+    int i;
+
+    for (i=0; i<NMANY; i++) {
+	sprintf(names[i], "o%d", i);
+	opts[i].name = names[i];
+	opts[i].has_arg = no_argument;
+	opts[i].flag = NULL;
+	opts[i].val = 0;
+    }
+    memset(&opts[NMANY], 0, sizeof(opts[NMANY]));
+
+    compiled = ultragetopt_constraints_create(many, ":z", opts);
+    if (compiled == NULL) {
+	printf("many options: not compiled\n");
+	return 1;
+    }
+
+    /* -z has no long alias, so it takes the bit after the long options */
+    if (compiled->shortbits['z'] != NMANY) {
+	printf("many options: -z has bit %d\n", compiled->shortbits['z']);
+	failures++;
+    }
+
+    failures += check_argv(compiled, ":z", opts, conflict, '?');
+    failures += check_argv(compiled, ":z", opts, require, '?');
+    failures += check_argv(compiled, ":z", opts, met, -1);
+    ultragetopt_constraints_free(compiled);
+
+    return failures;
+}
+
+int main(void)
+{
+    static const struct {
+	char *args[8];
+	int expected;
+    } cases[] = {
+	/* Every constraint met */
+	{ { "--json", "-i", "x" }, -1 },
+	{ { "-q", "--quiet", "--text", "-f", "y" }, -1 },
+	{ { "-v", "--verbose", "--xml", "--input=x" }, -1 },
+	{ { "--output=o", "--input", "x", "-f", "y", "--xml" }, -1 },
+	{ { "-i", "x", "-f", "y", "--text" }, -1 },
+
+	/* UGO_CONFLICT, through the long option and the short alias */
+	{ { "-q", "--verbose", "--json", "-f", "y" }, '?' },
+	{ { "--quiet", "-v", "--json", "-f", "y" }, '?' },
+
+	/* UGO_REQUIRE:  --output without -f */
+	{ { "--output", "o", "-i", "x", "--json" }, '?' },
+
+	/* UGO_ONEOF:  two of the options, then none */
+	{ { "--json", "--xml", "-i", "x" }, '?' },
+	{ { "-i", "x" }, '?' },
+
+	/* UGO_ANYOF:  none of the options */
+	{ { "--json", "-q" }, '?' }
+    };
+    static const struct ultragetopt_constraint unknown[] = {
+	{ UGO_CONFLICT, "quiet nosuch" },
+	{ 0, NULL }
+    };
+    struct ultragetopt_constraints *compiled;
+    int failures = 0;
+    size_t i;
+
+    compiled = ultragetopt_constraints_create(constraints, ":qvi:f:",
+					      longopts);
+    if (compiled == NULL) {
+	printf("constraints not compiled\n");
+	return EXIT_FAILURE;
+    }
+
+    /* Short options with a long alias share its bit, others follow */
+    if (compiled->shortbits['q'] != 0 || compiled->shortbits['v'] != 1
+	|| compiled->shortbits['i'] != 2 || compiled->shortbits['f'] != 7) {
+	printf("short option bits are -q %d -v %d -i %d -f %d\n",
+	       compiled->shortbits['q'], compiled->shortbits['v'],
+	       compiled->shortbits['i'], compiled->shortbits['f']);
+	failures++;
+    }
+
+    for (i=0; i<sizeof(cases)/sizeof(cases[0]); i++) {
+	char *argv[9];
+	int j;
+
+	argv[0] = "prog";
+	for (j=0; j<8 && cases[i].args[j] != NULL; j++)
+	    argv[j+1] = cases[i].args[j];
+	argv[j+1] = NULL;
+	failures += check_argv(compiled, ":qvi:f:", longopts, argv,
+			       cases[i].expected);
+    }
+    ultragetopt_constraints_free(compiled);
+
+    failures += check_many();
+
+    /* Naming an option not in the table is an error */
+    compiled = ultragetopt_constraints_create(unknown, ":qvi:f:", longopts);
+    if (compiled != NULL) {
+	printf("unknown option compiled\n");
+	ultragetopt_constraints_free(compiled);
+	failures++;
+    }
+
+    if (failures > 0) {
+	printf("%d constraint checks failed\n", failures);
+	return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+/* Check the handlers called by ultragetopt_dispatch()
+ *
+ * Each handler appends the option it was called for to a log, which must
+ * list the options in argv order, and the value which stops dispatching must
+ * be returned.
+ *
+ * This program is part of ultragetopt, see COPYING for licensing details
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ultragetopt.h"
+
+/* Context passed to the handlers */
+struct dispatch_log {
+    char text[256];	/* One "opt,longind,arg;" entry per handler call */
+    int stop;		/* Option whose handler returns 42, or 0 */
+};
+
+static int flag;
+
+static const struct option longopts[] = {
+    { "out", required_argument, NULL, 'o' },
+    { "verbose", no_argument, NULL, 'v' },
+    { "flag", no_argument, &flag, 1 },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Handler logging each call */
+static int log_option(void *context, int opt, int longind, char *arg)
+{
+    struct dispatch_log *log = context;
+    size_t len = strlen(log->text);
+
+    sprintf(log->text + len, "%c,%d,%s;", opt == 1 ? '1' : opt, longind,
+	    arg != NULL ? arg : "");
+
+    return opt == log->stop ? 42 : 0;
+}
+
+/* Dispatch argv and check the log, return value, and ultraoptind
+ * table - table to dispatch with, or NULL to use ultragetopt_dispatch()
+ * Returns 0 if they are as expected, 1 if not
+ */
+static int check_dispatch(const char *name,
+			  const struct ultragetopt_table *table,
+			  const struct ultragetopt_handlers *handlers,
+			  int stop, const char *expected, int expectedret,
+			  int expectedind)
+{
+    char *argv[] = {
+	"prog", "-v", "x", "--out=f", "--flag", "--verbose", "-q", "y", NULL
+    };
+    struct dispatch_log log;
+    int ret;
+
+    log.text[0] = '\0';
+    log.stop = stop;
+    flag = 0;
+
+    ultraoptreset = 1;
+    if (table != NULL)
+	ret = ultragetopt_dispatch_table(8, argv, table, handlers, &log);
+    else
+	ret = ultragetopt_dispatch(8, argv, "-:vo:", longopts, handlers, &log);
+
+    if (strcmp(log.text, expected) != 0 || ret != expectedret
+	|| ultraoptind != expectedind) {
+	printf("%s: returned %d, ultraoptind %d, log \"%s\"\n", name, ret,
+	       ultraoptind, log.text);
+	return 1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    static ultragetopt_handler shorthandlers[256];
+    static ultragetopt_handler longhandlers[3];
+    struct ultragetopt_handlers handlers;
+    struct ultragetopt_table table;
+    int failures = 0;
+
+    shorthandlers['v'] = log_option;
+    longhandlers[0] = log_option;
+    handlers.shorthandlers = shorthandlers;
+    handlers.longhandlers = longhandlers;
+    handlers.error = log_option;
+    handlers.operand = log_option;
+
+    /* Every option in order, --verbose through the handler for -v and
+     * --flag (which has no handler) only setting its flag */
+    failures += check_dispatch("all", NULL, &handlers, 0,
+			       "v,-1,;1,-1,x;o,0,f;v,1,;?,-1,;1,-1,y;",
+			       0, 8);
+    if (flag != 1) {
+	printf("all: flag not set\n");
+	failures++;
+    }
+
+    /* A handler returning non-zero stops dispatching */
+    failures += check_dispatch("stop", NULL, &handlers, 'o',
+			       "v,-1,;1,-1,x;o,0,f;", 42, 4);
+    failures += check_dispatch("stop at error", NULL, &handlers, '?',
+			       "v,-1,;1,-1,x;o,0,f;v,1,;?,-1,;", 42, 7);
+
+    /* Without an error handler errors are returned */
+    handlers.error = NULL;
+    failures += check_dispatch("no error handler", NULL, &handlers, 0,
+			       "v,-1,;1,-1,x;o,0,f;v,1,;", '?', 7);
+    handlers.error = log_option;
+
+    /* The same through a precomputed table */
+    memset(&table, 0, sizeof(table));
+    table.shortopts = "-:vo:";
+    table.longopts = longopts;
+    table.nlongopts = 3;
+    failures += check_dispatch("table", &table, &handlers, 0,
+			       "v,-1,;1,-1,x;o,0,f;v,1,;?,-1,;1,-1,y;",
+			       0, 8);
+
+    if (failures > 0) {
+	printf("%d dispatches differ\n", failures);
+	return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,219 @@
+/* Check reading options from configuration files with ultragetopt_file()
+ *
+ * Each file is written, read back through ultragetopt_file_r(), and the
+ * options, arguments, and line numbers returned compared against those
+ * expected.  Files are sized so that both the mapped and the read paths are
+ * taken where mmap() is available.
+ *
+ * This program is part of ultragetopt, see COPYING for licensing details
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_UNISTD_H && HAVE_SYSCONF
+# include <unistd.h>	/* sysconf() */
+#endif
+
+#include "ultragetopt.h"
+
+#define TESTFILE	"file-test.tmp"
+
+static const struct option longopts[] = {
+    { "verbose", no_argument, NULL, 'v' },
+    { "output", required_argument, NULL, 'o' },
+    { "level", optional_argument, NULL, 0 },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Option expected from a file, ending with opt -1 */
+struct result {
+    int opt;		/* Value returned */
+    const char *arg;	/* Expected ultraoptarg, or NULL */
+    int line;		/* Expected line number */
+};
+
+/* Size of a page, as used by ultragetopt_file_open() */
+static size_t page_size(void)
+{
+#if HAVE_UNISTD_H && HAVE_SYSCONF && defined(_SC_PAGESIZE)
+    long size = sysconf(_SC_PAGESIZE);
+
+    if (size > 0)
+	return (size_t)size;
+#endif
+    return 4096;
+}
+
+/* Write len bytes of data to TESTFILE
+ * Returns 0 on success, -1 on failure
+ */
+static int write_file(const char *data, size_t len)
+{
+    FILE *fp = fopen(TESTFILE, "wb");
+
+    if (fp == NULL)
+	return -1;
+    if (fwrite(data, 1, len, fp) != len) {
+	fclose(fp);
+	return -1;
+    }
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+/* Read data as a configuration file and check the options against expected
+ * mapped - 1 if the file must be mapped, 0 if it must be read, -1 if either
+ * Returns 0 if they match, 1 if not
+ */
+static int check_file(const char *name, const char *data, size_t len,
+		      int mapped, const struct result *expected)
+{
+    struct ultragetopt_occurrence longocc[3];
+    struct ultragetopt_occurrences occ;
+    struct ultragetopt_state state;
+    struct ultragetopt_table table;
+    struct ultragetopt_file file;
+    int failed = 0;
+    int i, c;
+
+    if (write_file(data, len) != 0
+	|| ultragetopt_file_open(&file, TESTFILE) != 0) {
+	printf("%s: can not write and open %s\n", name, TESTFILE);
+	return 1;
+    }
+
+#if !(HAVE_SYS_MMAN_H && HAVE_MMAP)
+    mapped = mapped > 0 ? 0 : mapped;
+#endif
+    if (mapped >= 0 && file.mapped != mapped) {
+	printf("%s: file is %s\n", name, file.mapped ? "mapped" : "read");
+	failed = 1;
+    }
+
+    memset(&table, 0, sizeof(table));
+    table.shortopts = "vo:";
+    table.longopts = longopts;
+    table.nlongopts = 3;
+
+    ultragetopt_state_init(&state);
+    state.opterr = 0;
+    ultragetopt_occurrences_init(&occ, longocc, 3);
+    state.occurrences = &occ;
+
+    for (i=0; !failed; i++) {
+	c = ultragetopt_file_r(&state, &file, &table, NULL, NULL, 0);
+	if (c != expected[i].opt
+	    || (c != -1 && file.line != expected[i].line)
+	    || (expected[i].arg == NULL) != (state.optarg == NULL)
+	    || (expected[i].arg != NULL
+		&& strcmp(expected[i].arg, state.optarg) != 0)) {
+	    printf("%s: result %d is %d \"%s\" on line %d\n", name, i, c,
+		   state.optarg != NULL ? state.optarg : "(null)",
+		   file.line);
+	    failed = 1;
+	}
+	if (c == -1)
+	    break;
+    }
+
+    /* Options from files are recorded, with the file as their index */
+    if (!failed && occ.shortopts['v'].count > 0
+	&& occ.shortopts['v'].first != UGO_FROMFILE) {
+	printf("%s: first occurrence of -v is %d\n", name,
+	       occ.shortopts['v'].first);
+	failed = 1;
+    }
+
+    ultragetopt_file_close(&file);
+
+    return failed;
+}
+
+int main(void)
+{
+    static const char comments[] =
+	"# A comment\n"
+	"verbose\n"
+	"\n"
+	"   # Indented comment\n"
+	"  output = a b  \n"
+	"v\n"
+	"level\n"
+	"level=2\n";
+    static const struct result comments_expected[] = {
+	{ 'v', NULL, 2 }, { 'o', "a b", 5 }, { 'v', NULL, 6 },
+	{ 0, NULL, 7 }, { 0, "2", 8 }, { -1, NULL, 0 }
+    };
+    static const char crlf[] = "verbose\r\no=x\r\n\r\noutput y z\r\n";
+    static const struct result crlf_expected[] = {
+	{ 'v', NULL, 1 }, { 'o', "x", 2 }, { 'o', "y z", 4 },
+	{ -1, NULL, 0 }
+    };
+    static const char nonewline[] = "verbose\noutput=last";
+    static const struct result nonewline_expected[] = {
+	{ 'v', NULL, 1 }, { 'o', "last", 2 }, { -1, NULL, 0 }
+    };
+    static const char badopt[] = "verbose\n\n# Comment\nnosuch=1\nv\n";
+    static const struct result badopt_expected[] = {
+	{ 'v', NULL, 1 }, { '?', NULL, 4 }, { 'v', NULL, 5 },
+	{ -1, NULL, 0 }
+    };
+    static const char badarg[] = "output=x\nverbose=1\noutput\n";
+    static const struct result badarg_expected[] = {
+	{ 'o', "x", 1 }, { '?', NULL, 2 }, { '?', NULL, 3 },
+	{ -1, NULL, 0 }
+    };
+    static const struct result page_expected[] = {
+	{ 'o', "x", 0 }, { -1, NULL, 0 }
+    };
+    struct result pagelast[2];
+    size_t pagesize = page_size();
+    char *page;
+    int failures = 0;
+
+    failures += check_file("comments", comments, sizeof(comments) - 1, 1,
+			   comments_expected);
+    failures += check_file("crlf", crlf, sizeof(crlf) - 1, 1,
+			   crlf_expected);
+    failures += check_file("no newline", nonewline, sizeof(nonewline) - 1,
+			   -1, nonewline_expected);
+    failures += check_file("bad option", badopt, sizeof(badopt) - 1, -1,
+			   badopt_expected);
+    failures += check_file("bad argument", badarg, sizeof(badarg) - 1, -1,
+			   badarg_expected);
+
+    /* A page of comment lines followed by one option, with and without a
+     * final newline.  Without one the '\0' after the last line can not go
+     * in the mapping, so the file must be read. */
+    page = malloc(pagesize);
+    if (page == NULL) {
+	printf("out of memory\n");
+	return EXIT_FAILURE;
+    }
+    memcpy(pagelast, page_expected, sizeof(pagelast));
+
+    memset(page, '#', pagesize);
+    page[pagesize - 10] = '\n';
+    memcpy(page + pagesize - 9, "output=x", 8);
+    page[pagesize - 1] = '\n';
+    pagelast[0].line = 2;
+    failures += check_file("page with newline", page, pagesize, 1,
+			   pagelast);
+
+    page[pagesize - 10] = '\n';
+    memcpy(page + pagesize - 9, "\noutput=x", 9);
+    pagelast[0].line = 3;
+    failures += check_file("page without newline", page, pagesize, 0,
+			   pagelast);
+    free(page);
+
+    remove(TESTFILE);
+
+    if (failures > 0) {
+	printf("%d files read differently\n", failures);
+	return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
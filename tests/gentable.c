@@ -0,0 +1,249 @@
+/* Check tables generated by ultragetopt-gen against the linear search
+ *
+ * Each table (built by the Makefile from a fixed option specification) is
+ * used to parse pseudo-random argvs made from its option names, their
+ * case-changed and truncated forms, and unknown names.  The results must
+ * match those of the same options parsed without the lookup structures.
+ * Packed tables registering the options of the largest one are checked the
+ * same way, as they grow and their hash is rehashed.
+ *
+ * This program is part of ultragetopt, see COPYING for licensing details
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ultragetopt.h"
+
+#define NARGVS	2000	/* argvs parsed per table and set of flags */
+#define MAXARGS	8	/* Elements of each argv after argv[0] */
+
+extern const struct ultragetopt_table vq_table;
+extern const struct ultragetopt_table ab_table;
+extern const struct ultragetopt_table big_table;
+
+static unsigned long seed = 1;
+
+/* Deterministic pseudo-random number in [0, n) */
+static int rnd(int n)
+{
+    seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return (int)((seed >> 8) % (unsigned long)n);
+}
+
+/* Fill buf with a random argv element for the nlongopts longopts */
+static void random_arg(const struct option *longopts, int nlongopts,
+		       char *buf, size_t bufsize)
+{
+    const char *name = "nosuchoption";
+    size_t len;
+    int i;
+
+    if (nlongopts > 0 && rnd(8) != 0)
+	name = longopts[rnd(nlongopts)].name;
+
+    switch (rnd(6)) {
+    case 0:			/* Short option (or cluster) */
+	sprintf(buf, "-%c%c", "abnrox"[rnd(6)], rnd(2) ? '\0' : 'a');
+	return;
+    case 1:			/* Non-option */
+	sprintf(buf, "word%d", rnd(10));
+	return;
+    case 2:			/* Truncated name */
+	len = strlen(name);
+	sprintf(buf, "--%.*s", (int)(len > 1 ? len - 1 : len), name);
+	return;
+    case 3:			/* Name with an adjacent argument */
+	sprintf(buf, "--%s=arg", name);
+	return;
+    default:
+	break;
+    }
+
+    if (strlen(name) + 3 > bufsize)
+	name = "x";
+    sprintf(buf, "--%s", name);
+    if (rnd(4) == 0)
+	for (i=2; buf[i] != '\0'; i++)
+	    buf[i] = (char)toupper((unsigned char)buf[i]);
+}
+
+/* Parse argv with table, recording everything returned in out
+ * Returns the number of entries recorded
+ */
+static int parse(int argc, char **argv, const struct ultragetopt_table *table,
+		 int flags, long *out)
+{
+    struct ultragetopt_state state;
+    int n = 0;
+    int c;
+
+    ultragetopt_state_init(&state);
+    state.opterr = 0;
+    do {
+	int longind = -1;
+
+	c = ultragetopt_tunable_r(&state, argc, argv, table, &longind,
+				  "=", "-", flags);
+	out[n++] = c;
+	out[n++] = longind;
+	out[n++] = state.optarg != NULL ? (long)(state.optarg - argv[0]) : -1;
+	out[n++] = state.optind;
+    } while (c != -1 && n < 4 * 4 * MAXARGS);
+
+    return n;
+}
+
+/* Check table against the linear search of its short options and the
+ * nlongopts longopts (NULL-terminated) for the given flags
+ * Returns the number of argvs parsed differently
+ */
+static int check_table(const char *name, const struct ultragetopt_table *table,
+		       const struct option *longopts, int nlongopts, int flags)
+{
+    struct ultragetopt_table linear;
+    char bufs[MAXARGS][64];
+    char *argv1[MAXARGS + 2], *argv2[MAXARGS + 2];
+    long out1[4 * 4 * MAXARGS], out2[4 * 4 * MAXARGS];
+    int failures = 0;
+    int i, j;
+
+    /* The same options without any lookup structures */
+    memset(&linear, 0, sizeof(linear));
+    linear.shortopts = table->shortopts;
+    linear.longopts = longopts;
+    linear.nlongopts = nlongopts;
+
+    for (i=0; i<NARGVS; i++) {
+	int argc = 1 + rnd(MAXARGS);
+	int n1, n2;
+
+	/* Offsets of optarg are taken from argv[0], so it holds the rest */
+	argv1[0] = argv2[0] = bufs[0];
+	strcpy(bufs[0], "prog");
+	for (j=1; j<argc; j++) {
+	    random_arg(longopts, nlongopts, bufs[j], sizeof(bufs[j]));
+	    argv1[j] = argv2[j] = bufs[j];
+	}
+	argv1[argc] = argv2[argc] = NULL;
+
+	n1 = parse(argc, argv1, table, flags, out1);
+	n2 = parse(argc, argv2, &linear, flags, out2);
+	if (n1 != n2 || memcmp(out1, out2, n1 * sizeof(long)) != 0
+	    || memcmp(argv1, argv2, sizeof(argv1[0]) * argc) != 0) {
+	    if (failures++ < 5) {
+		printf("%s (flags %#x) differs for:", name, flags);
+		for (j=1; j<argc; j++)
+		    printf(" %s", bufs[j]);
+		printf("\n");
+	    }
+	}
+    }
+
+    return failures;
+}
+
+/* Check packed tables registering the options of table one at a time,
+ * against the linear search of the options registered so far
+ * Returns the number of failures
+ */
+static int check_packed(const struct ultragetopt_table *table,
+			const int *flagsets, int nflagsets)
+{
+    struct ultragetopt_packed *packed;
+    struct ultragetopt_table packedtable;
+    struct option *longopts;
+    int failures = 0;
+    int i, j;
+
+    packed = ultragetopt_packed_create();
+    longopts = calloc((size_t)table->nlongopts + 1, sizeof(*longopts));
+    if (packed == NULL || longopts == NULL) {
+	printf("packed: out of memory\n");
+	return 1;
+    }
+
+    for (i=0; i<table->nlongopts; i++) {
+	const struct option *opt = &table->longopts[i];
+	unsigned long slotmask = packed->slotmask;
+	char name[32];
+
+	if (ultragetopt_packed_add(packed, opt->name, opt->has_arg, opt->flag,
+				   opt->val) != i
+	    || ultragetopt_packed_add(packed, opt->name, no_argument, NULL,
+				      0) != -1) {
+	    printf("packed: %s not added once\n", opt->name);
+	    failures++;
+	    break;
+	}
+	longopts[i] = *opt;
+
+	/* Every option registered so far is still found after a rehash */
+	for (j=0; j<=i; j++)
+	    if (ultragetopt_packed_find(packed, longopts[j].name) != j) {
+		printf("packed: %s not found among %d\n", longopts[j].name,
+		       i + 1);
+		failures++;
+	    }
+	sprintf(name, "%s-", opt->name);
+	if (ultragetopt_packed_find(packed, name) != -1) {
+	    printf("packed: %s found\n", name);
+	    failures++;
+	}
+
+	/* Parse with the first option, with the options just before and just
+	 * after each rehash, and with all of them */
+	if (i == 0 || packed->slotmask != slotmask
+	    || 2 * ((unsigned long)i + 2) > packed->slotmask + 1
+	    || i+1 == table->nlongopts) {
+	    ultragetopt_packed_table(packed, table->shortopts, &packedtable);
+	    for (j=0; j<nflagsets; j++)
+		failures += check_table("packed", &packedtable, longopts, i+1,
+					flagsets[j]);
+	}
+    }
+
+    ultragetopt_packed_free(packed);
+    free(longopts);
+
+    return failures;
+}
+
+int main(void)
+{
+    static const struct {
+	const char *name;
+	const struct ultragetopt_table *table;
+    } tables[] = {
+	{ "vq", &vq_table },
+	{ "ab", &ab_table },
+	{ "big", &big_table }
+    };
+    static const int flagsets[] = {
+	UGO_OPTIONPERMUTE | UGO_OPTIONALARG,
+	UGO_OPTIONPERMUTE | UGO_OPTIONALARG | UGO_CASEINSENSITIVE,
+	UGO_OPTIONALARG | UGO_LONGOPTADJACENT,
+	UGO_OPTIONPERMUTE | UGO_SINGLELEADERLONG | UGO_CASEINSENSITIVE
+	    | UGO_LONGOPTADJACENT
+    };
+    int failures = 0;
+    size_t i, j;
+
+    for (i=0; i<sizeof(tables)/sizeof(tables[0]); i++)
+	for (j=0; j<sizeof(flagsets)/sizeof(flagsets[0]); j++)
+	    failures += check_table(tables[i].name, tables[i].table,
+				    tables[i].table->longopts,
+				    tables[i].table->nlongopts, flagsets[j]);
+
+    failures += check_packed(&big_table, flagsets,
+			     (int)(sizeof(flagsets)/sizeof(flagsets[0])));
+
+    if (failures > 0) {
+	printf("%d argvs parsed differently\n", failures);
+	return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
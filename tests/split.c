@@ -0,0 +1,128 @@
+/* Check splitting list arguments with ultragetopt_split()
+ *
+ * Options are parsed with a table declaring separators for some of them,
+ * and the argument of each is split with the separators of that option
+ * (ultraoptseps).  The elements must match those expected, including empty
+ * elements.
+ *
+ * This program is part of ultragetopt, see COPYING for licensing details
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ultragetopt.h"
+
+static const struct option longopts[] = {
+    { "define", required_argument, NULL, 'D' },
+    { "list", required_argument, NULL, 0 },
+    { "output", required_argument, NULL, 'o' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Parse the single option in argv and split its argument
+ * expected - elements joined with '|'
+ * Returns 0 if they match, 1 if not
+ */
+static int check_split(const struct ultragetopt_table *table, int argc,
+		       char **argv, const char *expected)
+{
+    struct ultragetopt_state state;
+    struct ultragetopt_span span;
+    const char *pos;
+    char joined[128];
+    size_t len = 0;
+    int n = 0;
+    int c;
+
+    ultragetopt_state_init(&state);
+    c = ultragetopt_tunable_r(&state, argc, argv, table, NULL, "=", "-",
+			      UGO_OPTIONPERMUTE);
+    if (c == -1 || c == '?' || c == ':') {
+	printf("%s: not parsed\n", argv[1]);
+	return 1;
+    }
+
+    pos = state.optarg;
+    while (ultragetopt_split(&pos, state.optseps, &span)) {
+	if (len + span.len + 2 > sizeof(joined))
+	    break;
+	if (n++ > 0)
+	    joined[len++] = '|';
+	memcpy(joined + len, span.ptr, span.len);
+	len += span.len;
+    }
+    joined[len] = '\0';
+
+    /* An argument, even an empty one, has at least one element */
+    if (n == 0 || strcmp(joined, expected) != 0) {
+	printf("%s: split as \"%s\"\n", argv[1], joined);
+	return 1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    static const char *const longseps[] = { ",", ";,", NULL };
+    static const struct {
+	char *args[3];
+	const char *expected;
+    } cases[] = {
+	/* Short option with its own separators */
+	{ { "-Da,b", NULL }, "a|b" },
+	{ { "-D", "a,,b" }, "a||b" },
+	/* Empty elements at either end, and an empty argument */
+	{ { "--define=,a,", NULL }, "|a|" },
+	{ { "--define=", NULL }, "" },
+	{ { "--define", "," }, "|" },
+	/* A long option with a different set of separators */
+	{ { "--list=a;b,c", NULL }, "a|b|c" },
+	{ { "--list", "a;;" }, "a||" },
+	/* No separators:  the whole argument is one element */
+	{ { "-oa,b;c", NULL }, "a,b;c" },
+	{ { "--output=a,b", NULL }, "a,b" }
+    };
+    const char *shortseps[256];
+    struct ultragetopt_table table;
+    struct ultragetopt_span span;
+    const char *pos = NULL;
+    int failures = 0;
+    size_t i;
+
+    memset(shortseps, 0, sizeof(shortseps));
+    shortseps['D'] = ",";
+
+    memset(&table, 0, sizeof(table));
+    table.shortopts = "D:o:";
+    table.longopts = longopts;
+    table.nlongopts = 3;
+    table.shortseps = shortseps;
+    table.longseps = longseps;
+
+    for (i=0; i<sizeof(cases)/sizeof(cases[0]); i++) {
+	char *argv[4];
+	int argc = cases[i].args[1] != NULL ? 3 : 2;
+
+	argv[0] = "prog";
+	argv[1] = cases[i].args[0];
+	argv[2] = cases[i].args[1];
+	argv[argc] = NULL;
+	failures += check_split(&table, argc, argv, cases[i].expected);
+    }
+
+    /* A missing argument has no elements */
+    if (ultragetopt_split(&pos, ",", &span)) {
+	printf("NULL argument split\n");
+	failures++;
+    }
+
+    if (failures > 0) {
+	printf("%d arguments split differently\n", failures);
+	return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
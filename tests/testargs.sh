@@ -2,7 +2,7 @@
 # Test arguments for ultragetopt and vendor-provided getopts
 
 # Please increment this when you add/changes tests!
-VERSION="24"
+VERSION="25"
 
 if [ -n "$1" ] ; then
 	GETOPT=$1
@@ -67,6 +67,8 @@ testopts "nr:o::" "optarg::" "progname" "word" "--optarg" "--n"
 testopts "nr:o::" "optarg:: n" "progname" "word" "--optarg" "--n"
 testopts "nr:o::" "optarg::" "progname" "word" "--optarg"
 testopts "nr:o::" "reqarg: optarg::" "progname" "word1" "word2" "--reqarg"
+testopts "nr:o::" "reqarg:" "progname" "word" "--reqarg" "arg"
+testopts "nr:o::" "reqarg:" "progname" "word" "--reqarg" "arg" "-n"
 
 # Arguments to non-arg options
 testopts "nr:o::" "noarg" "progname" "--noarg=arg"
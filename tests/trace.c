@@ -0,0 +1,118 @@
+/* Check the events recorded in a trace and their JSON dump
+ *
+ * The same argv is parsed with a trace large enough for every event, with
+ * one which wraps around and keeps only the last events, and with an empty
+ * one.  The dump of each must match the expected JSON exactly.
+ *
+ * This program is part of ultragetopt, see COPYING for licensing details
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ultragetopt.h"
+
+static const struct option longopts[] = {
+    { "out", required_argument, NULL, 'o' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Dump of the last events of parsing the argv of check_trace() */
+static const char lastevents[] =
+    "  {\"seq\": 12, \"event\": \"permute\", \"index\": 6, \"to\": 5},\n"
+    "  {\"seq\": 13, \"event\": \"error\", \"index\": 5, \"return\": \"?\"},\n"
+    "  {\"seq\": 14, \"event\": \"classify\", \"index\": 6, "
+	"\"class\": \"operand\"},\n"
+    "  {\"seq\": 15, \"event\": \"end\", \"index\": 6}\n"
+    "]\n";
+
+/* Parse argv recording into a trace of nevents, and check its dump
+ * Returns 0 if the dump is as expected, 1 if not
+ */
+static int check_trace(size_t nevents, unsigned long expectednext,
+		       const char *expected)
+{
+    char *argv[] = {
+	"prog", "-a", "x", "-bval", "--out", "f", "-q", NULL
+    };
+    struct ultragetopt_event events[64];
+    struct ultragetopt_trace trace;
+    char dump[2048];
+    size_t len;
+    FILE *out;
+
+    ultragetopt_trace_init(&trace, events, nevents);
+    ultraopttrace = &trace;
+    ultraoptreset = 1;
+    while (ultragetopt_long(7, argv, ":ab:", longopts, NULL) != -1)
+	;
+    ultraopttrace = NULL;
+
+    out = tmpfile();
+    if (out == NULL || ultragetopt_trace_dump(&trace, out) != 0) {
+	printf("%lu events: can not dump\n", (unsigned long)nevents);
+	return 1;
+    }
+    rewind(out);
+    len = fread(dump, 1, sizeof(dump) - 1, out);
+    dump[len] = '\0';
+    fclose(out);
+
+    if (trace.next != expectednext || strcmp(dump, expected) != 0) {
+	printf("%lu events: %lu recorded, dump:\n%s", (unsigned long)nevents,
+	       trace.next, dump);
+	return 1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    static const char allevents[] =
+	"[\n"
+	"  {\"seq\": 0, \"event\": \"classify\", \"index\": 1, "
+	    "\"class\": \"option\"},\n"
+	"  {\"seq\": 1, \"event\": \"short\", \"index\": 1, "
+	    "\"option\": \"a\"},\n"
+	"  {\"seq\": 2, \"event\": \"classify\", \"index\": 2, "
+	    "\"class\": \"operand\"},\n"
+	"  {\"seq\": 3, \"event\": \"permute\", \"index\": 3, \"to\": 2},\n"
+	"  {\"seq\": 4, \"event\": \"short\", \"index\": 2, "
+	    "\"option\": \"b\"},\n"
+	"  {\"seq\": 5, \"event\": \"argument\", \"index\": 2, "
+	    "\"offset\": 2},\n"
+	"  {\"seq\": 6, \"event\": \"classify\", \"index\": 3, "
+	    "\"class\": \"operand\"},\n"
+	"  {\"seq\": 7, \"event\": \"permute\", \"index\": 4, \"to\": 3},\n"
+	"  {\"seq\": 8, \"event\": \"permute\", \"index\": 5, \"to\": 4},\n"
+	"  {\"seq\": 9, \"event\": \"long\", \"index\": 3, "
+	    "\"longind\": 0},\n"
+	"  {\"seq\": 10, \"event\": \"argument\", \"index\": 4, "
+	    "\"offset\": 0},\n"
+	"  {\"seq\": 11, \"event\": \"classify\", \"index\": 5, "
+	    "\"class\": \"operand\"},\n";
+    char expected[2048];
+    int failures = 0;
+
+    /* Room for every event */
+    strcpy(expected, allevents);
+    strcat(expected, lastevents);
+    failures += check_trace(64, 16, expected);
+
+    /* 6 is rounded down to 4, so only the last 4 events are kept */
+    strcpy(expected, "[\n");
+    strcat(expected, lastevents);
+    failures += check_trace(6, 16, expected);
+
+    /* No room for any event:  nothing is recorded */
+    failures += check_trace(0, 0, "[]\n");
+
+    if (failures > 0) {
+	printf("%d traces differ\n", failures);
+	return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,191 @@
+/* Check the value lists made by ultragetopt_values_create()
+ *
+ * One list outgrows the small arena supplied by the caller and continues in
+ * blocks allocated by the library, while another stays in the caller's
+ * arena.  Every argument must be kept in order, and resetting the lists (as
+ * ultragetopt_values_free() does) must give back the caller's arena and
+ * release every block.
+ *
+ * This program is part of ultragetopt, see COPYING for licensing details
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ultragetopt.h"
+
+#define NINCLUDES	1000	/* Arguments accumulated for -I */
+#define NDEFINES	3	/* Arguments accumulated for -D */
+#define MAXBLOCKS	8	/* Most blocks the -I list may take */
+
+static const struct option longopts[] = {
+    { "include", required_argument, NULL, 'I' },
+    { "define", required_argument, NULL, 'D' },
+    { "verbose", no_argument, NULL, 'v' },
+    { NULL, 0, NULL, 0 }
+};
+
+static char *argv[2 * NINCLUDES + NDEFINES + 2];
+static char args[NINCLUDES + NDEFINES][24];
+
+/* Is p inside the size bytes at arena? */
+static int in_arena(const void *p, const void *arena, size_t size)
+{
+    return (const char *)p >= (const char *)arena
+	&& (const char *)p < (const char *)arena + size;
+}
+
+/* Fill argv with the -D options, then the -I options mixing short and long,
+ * separate and attached arguments, with operands between them
+ * Returns argc
+ */
+static int make_argv(void)
+{
+    int argc = 0;
+    int i;
+
+    argv[argc++] = "prog";
+    for (i=0; i<NDEFINES; i++) {
+	sprintf(args[NINCLUDES + i], "-Ddef%d", i);
+	argv[argc++] = args[NINCLUDES + i];
+    }
+    for (i=0; i<NINCLUDES; i++) {
+	if (i % 2 == 0) {
+	    sprintf(args[i], "-Iinc%d", i);
+	} else if (i % 3 == 0) {
+	    argv[argc++] = "--include";
+	    sprintf(args[i], "inc%d", i);
+	} else {
+	    sprintf(args[i], "--include=inc%d", i);
+	}
+	argv[argc++] = args[i];
+	if (i % 100 == 0)
+	    argv[argc++] = "operand";
+    }
+    argv[argc] = NULL;
+
+    return argc;
+}
+
+/* Check that list holds count arguments named prefix0, prefix1, ...
+ * Returns 0 if it does, 1 if not
+ */
+static int check_list(const char *name, char **list, int count,
+		      int expected, const char *prefix)
+{
+    char buf[24];
+    int i;
+
+    if (count != expected) {
+	printf("%s: %d values\n", name, count);
+	return 1;
+    }
+
+    for (i=0; i<count; i++) {
+	sprintf(buf, "%s%d", prefix, i);
+	if (strcmp(list[i], buf) != 0) {
+	    printf("%s: value %d is \"%s\"\n", name, i, list[i]);
+	    return 1;
+	}
+    }
+
+    return 0;
+}
+
+/* Parse argv accumulating into values, and check the lists
+ * Returns the number of failures
+ */
+static int check_values(struct ultragetopt_values *values, void *arena,
+			size_t arenasize)
+{
+    struct ultragetopt_state state;
+    char **includes, **defines;
+    int nincludes, ndefines;
+    int argc = make_argv();
+    int failures = 0;
+    int nblocks = 0;
+    void *block;
+    int c;
+
+    ultragetopt_state_init(&state);
+    state.values = values;
+    while ((c = ultragetopt_long_r(&state, argc, argv, ":I:D:v", longopts,
+				   NULL)) != -1)
+	if (c != 'I' && c != 'D') {
+	    printf("unexpected option %d\n", c);
+	    failures++;
+	}
+
+    includes = ultragetopt_values_get(values, "include", &nincludes);
+    defines = ultragetopt_values_get(values, "D", &ndefines);
+    failures += check_list("include", includes, nincludes, NINCLUDES, "inc");
+    failures += check_list("D", defines, ndefines, NDEFINES, "def");
+    if (values->failed) {
+	printf("values dropped\n");
+	failures++;
+    }
+
+    /* -D is given first, so its list is in the caller's arena, while -I
+     * grew out of it into blocks (each starting with the next block) */
+    if (!in_arena(defines, arena, arenasize)
+	|| in_arena(includes, arena, arenasize)) {
+	printf("lists not placed in the caller's arena then blocks\n");
+	failures++;
+    }
+    for (block=values->blocks; block != NULL; block=*(void **)block)
+	nblocks++;
+    if (nblocks == 0 || nblocks > MAXBLOCKS) {
+	printf("%d blocks allocated\n", nblocks);
+	failures++;
+    }
+
+    /* Resetting releases the blocks and starts over in the caller's arena */
+    ultragetopt_values_reset(values);
+    if (values->blocks != NULL || values->arena != arena
+	|| values->arenaused != 0
+	|| ultragetopt_values_get(values, "I", &nincludes) != NULL) {
+	printf("values not reset\n");
+	failures++;
+    }
+
+    return failures;
+}
+
+int main(void)
+{
+    /* Room for 16 pointers:  -D and the first list of -I, but not the
+     * second */
+    char *arena[16];
+    struct ultragetopt_values *values;
+    int failures = 0;
+    int argc;
+
+    values = ultragetopt_values_create("include D", ":I:D:v", longopts,
+				       arena, sizeof(arena));
+    if (values == NULL) {
+	printf("values not created\n");
+	return EXIT_FAILURE;
+    }
+
+    failures += check_values(values, arena, sizeof(arena));
+    /* Again after the reset, to check the lists can be reused */
+    failures += check_values(values, arena, sizeof(arena));
+
+    /* A single free releases everything, including the blocks of a list
+     * which is not reset first */
+    argc = make_argv();
+    ultraoptvalues = values;
+    ultraoptreset = 1;
+    while (ultragetopt_long(argc, argv, ":I:D:v", longopts, NULL) != -1)
+	;
+    ultraoptvalues = NULL;
+    ultragetopt_values_free(values);
+
+    if (failures > 0) {
+	printf("%d value checks failed\n", failures);
+	return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
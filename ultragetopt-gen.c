@@ -0,0 +1,703 @@
+/* ultragetopt-gen - Generate a precomputed option table for ultragetopt
+ *
+ * Reads an option specification (a shortopts string and a space-separated
+ * list of long options, in the same form as tests/getopt.c) and writes C
+ * source defining a struct ultragetopt_table with a minimal perfect hash of
+ * the long option names, a trie of the long option names (for longest-prefix
+ * matching), the short option dispatch table, the length of each long option
+ * name, and the list separators of each option (if any).  Link the result
+ * with libultragetopt and pass the table to ultragetopt_long_table() or
+ * ultragetopt_tunable_table().
+ *
+ * This program is part of ultragetopt, see COPYING for licensing details
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ultragetopt.h"
+
+/* Largest displacement tried for a hash bucket before giving up */
+#define MAXDISP 0x1000000
+
+struct longspec {
+    char *name;		/* Name of the option */
+    size_t len;		/* Length of name */
+    int has_arg;	/* no_argument, required_argument, optional_argument */
+    int val;		/* Value returned for the option */
+    const char *seps;	/* List separators for the argument, or NULL */
+};
+
+static void usage(const char *progname)
+{
+    fprintf(stderr,
+	    "Usage:  %s [-o outfile] [-p prefix] [-s opt=separators]...\n"
+	    "\t\t<shortopts> <longopts>\n"
+	    "<shortopts>\tString of shortopts as passed to getopt()\n"
+	    "<longopts>\tSpace-separated list of long options, using the\n"
+	    "\t\tsame : notation for arguments as short options and an\n"
+	    "\t\toptional =val suffix (character or number) for the value\n"
+	    "\t\treturned (default is the first character of the name)\n"
+	    "-o outfile\tWrite the table to outfile rather than stdout\n"
+	    "-p prefix\tPrefix for generated identifiers (default "
+	    "\"ultragetopt\")\n"
+	    "-s opt=separators\n"
+	    "\t\tArgument of opt (a short option character, or a long\n"
+	    "\t\toption name) is a list split at any of separators\n",
+	    progname);
+}
+
+/* Parse the long option specification in spec (which is modified)
+ * Returns the array of long options and sets *count, or NULL on error
+ */
+static struct longspec *parse_longopts(char *spec, int *count)
+{
+    struct longspec *opts;
+    char *name, *cur;
+    int n = 1;
+    int i;
+
+    for (cur = spec; *cur; cur++)
+	if (*cur == ' ')
+	    n++;
+
+    opts = malloc(sizeof(struct longspec) * n);
+    if (opts == NULL) {
+	fprintf(stderr, "Unable to allocate memory for long options.\n");
+	return NULL;
+    }
+
+    name = strtok(spec, " ");
+    for (i=0; name != NULL; i++) {
+	char *valstr = strchr(name, '=');
+	size_t namelen;
+
+	opts[i].val = name[0];
+	opts[i].seps = NULL;
+	if (valstr != NULL) {
+	    *valstr++ = '\0';
+	    if (valstr[0] != '\0' && valstr[1] == '\0'
+		&& !isdigit((unsigned char)valstr[0]))
+		opts[i].val = (unsigned char)valstr[0];
+	    else {
+		char *end;
+
+		opts[i].val = (int)strtol(valstr, &end, 0);
+		if (*valstr == '\0' || *end != '\0') {
+		    fprintf(stderr, "Invalid value for option %s: %s\n",
+			    name, valstr);
+		    free(opts);
+		    return NULL;
+		}
+	    }
+	}
+
+	namelen = strlen(name);
+	if (namelen > 0 && name[namelen-1] == ':') {
+	    if (namelen > 1 && name[namelen-2] == ':') {
+		opts[i].has_arg = optional_argument;
+		namelen -= 2;
+	    } else {
+		opts[i].has_arg = required_argument;
+		namelen -= 1;
+	    }
+	    name[namelen] = '\0';
+	} else
+	    opts[i].has_arg = no_argument;
+
+	if (namelen == 0) {
+	    fprintf(stderr, "Empty long option name\n");
+	    free(opts);
+	    return NULL;
+	}
+
+	opts[i].name = name;
+	opts[i].len = namelen;
+
+	name = strtok(NULL, " ");
+    }
+
+    *count = i;
+    return opts;
+}
+
+/* Apply the -s option separator specifications in specs (which are modified)
+ * Returns 0 on success, -1 on error
+ */
+static int apply_seps(char **specs, int nspecs, const char *shortopts,
+		      const char **shortseps, struct longspec *opts, int n)
+{
+    int i, j;
+
+    for (i=0; i<nspecs; i++) {
+	char *seps = strchr(specs[i], '=');
+
+	if (seps == NULL || seps == specs[i] || seps[1] == '\0') {
+	    fprintf(stderr, "Invalid separator specification: %s\n",
+		    specs[i]);
+	    return -1;
+	}
+	*seps++ = '\0';
+
+	/* Single characters are short options */
+	if (specs[i][1] == '\0' && specs[i][0] != ':'
+	    && strchr(shortopts, specs[i][0]) != NULL) {
+	    shortseps[(unsigned char)specs[i][0]] = seps;
+	    continue;
+	}
+
+	for (j=0; j<n; j++)
+	    if (strcmp(opts[j].name, specs[i]) == 0)
+		break;
+	if (j == n) {
+	    fprintf(stderr, "Unknown option for separators: %s\n", specs[i]);
+	    return -1;
+	}
+	opts[j].seps = seps;
+    }
+
+    return 0;
+}
+
+/* Compare long options by case-folded name, for qsort() */
+static int compare_folded(const void *a, const void *b)
+{
+    const unsigned char *s1 = (const unsigned char *)
+	(*(const struct longspec *const *)a)->name;
+    const unsigned char *s2 = (const unsigned char *)
+	(*(const struct longspec *const *)b)->name;
+
+    while (*s1 && tolower(*s1) == tolower(*s2)) {
+	s1++;
+	s2++;
+    }
+
+    return tolower(*s1) - tolower(*s2);
+}
+
+/* Check that no two long option names differ only in case
+ * (they would always collide in the case-insensitive hash)
+ */
+static int check_duplicates(const struct longspec *opts, int n)
+{
+    const struct longspec **sorted;
+    int i, ret = 0;
+
+    if (n < 2)
+	return 0;
+
+    sorted = malloc(sizeof(*sorted) * n);
+    if (sorted == NULL) {
+	fprintf(stderr, "Unable to allocate memory for long options.\n");
+	return -1;
+    }
+
+    for (i=0; i<n; i++)
+	sorted[i] = &opts[i];
+    qsort(sorted, n, sizeof(*sorted), compare_folded);
+
+    for (i=1; i<n; i++)
+	if (compare_folded(&sorted[i-1], &sorted[i]) == 0) {
+	    fprintf(stderr, "Duplicate long option (ignoring case): %s %s\n",
+		    sorted[i-1]->name, sorted[i]->name);
+	    ret = -1;
+	}
+
+    free(sorted);
+    return ret;
+}
+
+/* Build a minimal perfect hash of the n long option names using
+ * hash-and-displace:  Each name falls in bucket hash(name, 0) % n.  Buckets
+ * with several names are placed first, each with the smallest displacement d
+ * that sends all of its names to free slots hash(name, d) % n.  Buckets with
+ * a single name are stored directly in a remaining slot as -slot-1.
+ * Returns 0 on success, -1 on failure
+ */
+static int build_hash(const struct longspec *opts, int n, int *disp,
+		      int *slots)
+{
+    int *bucket, *size, *start, *order, *tryslots;
+    int maxsize = 0, freeslot = 0;
+    int i, b, s;
+    int ret = 0;
+
+    bucket = malloc(sizeof(int) * n);
+    size = calloc(n, sizeof(int));
+    start = malloc(sizeof(int) * (n + 1));
+    order = malloc(sizeof(int) * n);
+    tryslots = malloc(sizeof(int) * n);
+    if (!bucket || !size || !start || !order || !tryslots) {
+	fprintf(stderr, "Unable to allocate memory for hash table.\n");
+	ret = -1;
+	goto done;
+    }
+
+    for (i=0; i<n; i++) {
+	bucket[i] = (int)(ultragetopt_hash(opts[i].name, opts[i].len, 0) % n);
+	size[bucket[i]]++;
+	disp[i] = 0;
+	slots[i] = -1;
+    }
+
+    /* Sort the names by bucket */
+    start[0] = 0;
+    for (b=0; b<n; b++) {
+	start[b+1] = start[b] + size[b];
+	if (size[b] > maxsize)
+	    maxsize = size[b];
+    }
+    for (b=0; b<n; b++)
+	size[b] = 0;
+    for (i=0; i<n; i++)
+	order[start[bucket[i]] + size[bucket[i]]++] = i;
+
+    /* Place the buckets with more than one name, largest first */
+    for (s = maxsize; s > 1; s--) {
+	for (b=0; b<n; b++) {
+	    int d;
+
+	    if (size[b] != s)
+		continue;
+
+	    for (d=1; d < MAXDISP; d++) {
+		int j, k;
+
+		for (j=0; j<s; j++) {
+		    const struct longspec *opt = &opts[order[start[b]+j]];
+
+		    tryslots[j] = (int)(ultragetopt_hash(opt->name, opt->len,
+							 d) % n);
+		    if (slots[tryslots[j]] != -1)
+			break;
+		    for (k=0; k<j; k++)
+			if (tryslots[k] == tryslots[j])
+			    break;
+		    if (k < j)
+			break;
+		}
+
+		if (j == s)
+		    break;
+	    }
+
+	    if (d == MAXDISP) {
+		fprintf(stderr, "Unable to find a perfect hash.\n");
+		ret = -1;
+		goto done;
+	    }
+
+	    disp[b] = d;
+	    for (i=0; i<s; i++)
+		slots[tryslots[i]] = order[start[b]+i];
+	}
+    }
+
+    /* Place the buckets with a single name in the remaining slots */
+    for (b=0; b<n; b++) {
+	if (size[b] != 1)
+	    continue;
+
+	while (slots[freeslot] != -1)
+	    freeslot++;
+
+	disp[b] = -freeslot - 1;
+	slots[freeslot] = order[start[b]];
+    }
+
+done:
+    free(bucket);
+    free(size);
+    free(start);
+    free(order);
+    free(tryslots);
+
+    return ret;
+}
+
+/* Build a compressed trie of the case-folded long option names
+ * Nodes are numbered breadth-first so that the children of each node are
+ * consecutive.  Each node covers the names in sorted[lo..hi) which share
+ * their first depth characters.
+ * nodes - at least 2*n+1 entries
+ * labels - at least the total length of the names plus one
+ * Returns the number of nodes, or -1 on failure
+ */
+static int build_trie(const struct longspec *opts, int n,
+		      struct ultragetopt_trienode *nodes, char *labels)
+{
+    const struct longspec **sorted;
+    size_t *depth;
+    int *lo, *hi;
+    int nnodes = 1, nlabels = 0;
+    int k;
+
+    sorted = malloc(sizeof(*sorted) * (n + 1));
+    depth = malloc(sizeof(size_t) * (2 * n + 1));
+    lo = malloc(sizeof(int) * (2 * n + 1));
+    hi = malloc(sizeof(int) * (2 * n + 1));
+    if (!sorted || !depth || !lo || !hi) {
+	fprintf(stderr, "Unable to allocate memory for trie.\n");
+	nnodes = -1;
+	goto done;
+    }
+
+    for (k=0; k<n; k++)
+	sorted[k] = &opts[k];
+    qsort(sorted, n, sizeof(*sorted), compare_folded);
+
+    nodes[0].label = 0;
+    nodes[0].labellen = 0;
+    lo[0] = 0;
+    hi[0] = n;
+    depth[0] = 0;
+
+    for (k=0; k<nnodes; k++) {
+	int first = lo[k];
+
+	/* A name ending here sorts before the others */
+	nodes[k].longind = -1;
+	if (first < hi[k] && sorted[first]->len == depth[k])
+	    nodes[k].longind = (int)(sorted[first++] - opts);
+
+	nodes[k].child = nnodes;
+	nodes[k].nchildren = 0;
+	while (first < hi[k]) {
+	    const char *name = sorted[first]->name;
+	    int c = tolower((unsigned char)name[depth[k]]);
+	    int last = first;
+	    const char *lastname;
+	    size_t len, j;
+
+	    while (last+1 < hi[k]
+		   && tolower((unsigned char)sorted[last+1]->name[depth[k]])
+		      == c)
+		last++;
+
+	    /* Label is the common prefix of the group (first and last) */
+	    lastname = sorted[last]->name;
+	    for (len = depth[k]+1;
+		 name[len] != '\0'
+		 && tolower((unsigned char)name[len])
+		    == tolower((unsigned char)lastname[len]);
+		 len++)
+		;
+
+	    nodes[nnodes].label = nlabels;
+	    nodes[nnodes].labellen = (int)(len - depth[k]);
+	    for (j = depth[k]; j < len; j++)
+		labels[nlabels++] = (char)tolower((unsigned char)name[j]);
+	    lo[nnodes] = first;
+	    hi[nnodes] = last + 1;
+	    depth[nnodes] = len;
+	    nnodes++;
+	    nodes[k].nchildren++;
+
+	    first = last + 1;
+	}
+    }
+    labels[nlabels] = '\0';
+
+done:
+    free(sorted);
+    free(depth);
+    free(lo);
+    free(hi);
+
+    return nnodes;
+}
+
+/* Print a string as a C string literal */
+static void print_string(FILE *out, const char *str)
+{
+    putc('"', out);
+    for ( ; *str; str++) {
+	if (*str == '"' || *str == '\\')
+	    fprintf(out, "\\%c", *str);
+	else if (isprint((unsigned char)*str))
+	    putc(*str, out);
+	else
+	    fprintf(out, "\\%03o", (unsigned char)*str);
+    }
+    putc('"', out);
+}
+
+/* Print entry i of n in an array of list separators, 4 per line */
+static void print_seps(FILE *out, const char *seps, int i, int n)
+{
+    fputs(i % 4 == 0 ? "\n    " : " ", out);
+    if (seps != NULL)
+	print_string(out, seps);
+    else
+	fputs("NULL", out);
+    if (i+1 < n)
+	putc(',', out);
+}
+
+/* Print an option value, as a character constant where possible */
+static void print_val(FILE *out, int val)
+{
+    if (val == '\'' || val == '\\')
+	fprintf(out, "'\\%c'", val);
+    else if (val > 0 && val < 128 && isprint(val))
+	fprintf(out, "'%c'", val);
+    else
+	fprintf(out, "%d", val);
+}
+
+/* Print an array of ints, 8 per line */
+static void print_ints(FILE *out, const char *prefix, const char *name,
+		       const int *values, int n)
+{
+    int i;
+
+    fprintf(out, "static const int %s_%s[] = {", prefix, name);
+    for (i=0; i<n; i++)
+	fprintf(out, "%s%d%s", i % 8 == 0 ? "\n    " : " ", values[i],
+		i+1 < n ? "," : "");
+    fprintf(out, "\n};\n\n");
+}
+
+static void print_table(FILE *out, const char *prefix, const char *shortopts,
+			const char *longspec, const struct longspec *opts,
+			int n, const int *disp, const int *slots,
+			const struct ultragetopt_trienode *trie, int nnodes,
+			const char *trielabels, const char *const *shortseps)
+{
+    static const char *const has_args[] = {
+	"no_argument", "required_argument", "optional_argument"
+    };
+    unsigned char shortargs[256];
+    int anyshortseps = 0, anylongseps = 0;
+    const char *cur;
+    int i;
+
+    /* Build short option dispatch table (skipping leading flags) */
+    memset(shortargs, 0, sizeof(shortargs));
+    for (cur = shortopts; *cur == '+' || *cur == '-' || *cur == ':'; cur++)
+	;
+    for ( ; *cur; cur++) {
+	int has_arg = no_argument;
+
+	if (*cur == ':')
+	    continue;
+
+	if (cur[1] == ':')
+	    has_arg = cur[2] == ':' ? optional_argument : required_argument;
+	shortargs[(unsigned char)*cur] = (unsigned char)(has_arg + 1);
+    }
+
+    fprintf(out, "/* Generated by ultragetopt-gen from:\n"
+		 " *   shortopts: %s\n"
+		 " *   longopts:  %s\n"
+		 " * Do not edit, regenerate instead.\n"
+		 " */\n\n"
+		 "#include \"ultragetopt.h\"\n\n",
+	    shortopts, longspec);
+
+    fprintf(out, "static const struct option %s_longopts[] = {\n", prefix);
+    for (i=0; i<n; i++) {
+	fprintf(out, "    { ");
+	print_string(out, opts[i].name);
+	fprintf(out, ", %s, NULL, ", has_args[opts[i].has_arg]);
+	print_val(out, opts[i].val);
+	fprintf(out, " },\n");
+    }
+    fprintf(out, "    { NULL, 0, NULL, 0 }\n};\n\n");
+
+    if (n > 0) {
+	fprintf(out, "static const size_t %s_namelens[] = {", prefix);
+	for (i=0; i<n; i++)
+	    fprintf(out, "%s%lu%s", i % 8 == 0 ? "\n    " : " ",
+		    (unsigned long)opts[i].len, i+1 < n ? "," : "");
+	fprintf(out, "\n};\n\n");
+
+	print_ints(out, prefix, "hashdisp", disp, n);
+	print_ints(out, prefix, "hashslots", slots, n);
+    }
+
+    fprintf(out, "static const unsigned char %s_shortargs[256] = {", prefix);
+    for (i=0; i<256; i++)
+	fprintf(out, "%s%d%s", i % 16 == 0 ? "\n    " : " ", shortargs[i],
+		i < 255 ? "," : "");
+    fprintf(out, "\n};\n\n");
+
+    for (i=0; i<256; i++)
+	if (shortseps[i] != NULL)
+	    anyshortseps = 1;
+    if (anyshortseps) {
+	fprintf(out, "static const char *const %s_shortseps[256] = {",
+		prefix);
+	for (i=0; i<256; i++)
+	    print_seps(out, shortseps[i], i, 256);
+	fprintf(out, "\n};\n\n");
+    }
+
+    for (i=0; i<n; i++)
+	if (opts[i].seps != NULL)
+	    anylongseps = 1;
+    if (anylongseps) {
+	fprintf(out, "static const char *const %s_longseps[] = {", prefix);
+	for (i=0; i<n; i++)
+	    print_seps(out, opts[i].seps, i, n);
+	fprintf(out, "\n};\n\n");
+    }
+
+    if (n > 0) {
+	fprintf(out, "static const struct ultragetopt_trienode %s_trie[] = {\n",
+		prefix);
+	for (i=0; i<nnodes; i++)
+	    fprintf(out, "    { %d, %d, %d, %d, %d }%s\n", trie[i].label,
+		    trie[i].labellen, trie[i].longind, trie[i].child,
+		    trie[i].nchildren, i+1 < nnodes ? "," : "");
+	fprintf(out, "};\n\nstatic const char %s_trielabels[] = ", prefix);
+	print_string(out, trielabels);
+	fprintf(out, ";\n\n");
+    }
+
+    fprintf(out, "const struct ultragetopt_table %s_table = {\n    ", prefix);
+    print_string(out, shortopts);
+    fprintf(out, ",\n    %s_longopts,\n    %d,\n", prefix, n);
+    if (n > 0)
+	fprintf(out, "    %s_namelens,\n    %s_hashdisp,\n    %s_hashslots,\n",
+		prefix, prefix, prefix);
+    else
+	fprintf(out, "    NULL,\n    NULL,\n    NULL,\n");
+    fprintf(out, "    %s_shortargs,\n", prefix);
+    if (anyshortseps)
+	fprintf(out, "    %s_shortseps,\n", prefix);
+    else
+	fprintf(out, "    NULL,\n");
+    if (anylongseps)
+	fprintf(out, "    %s_longseps,\n", prefix);
+    else
+	fprintf(out, "    NULL,\n");
+    if (n > 0)
+	fprintf(out, "    %s_trie,\n    %s_trielabels,\n", prefix, prefix);
+    else
+	fprintf(out, "    NULL,\n    NULL,\n");
+    fprintf(out, "    NULL\n};\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct longspec *opts;
+    const char *outname = NULL;
+    const char *prefix = "ultragetopt";
+    const char *shortseps[256];
+    char *longspec;
+    char **sepspecs;
+    int *disp = NULL, *slots = NULL;
+    struct ultragetopt_trienode *trie = NULL;
+    char *trielabels = NULL;
+    size_t len;
+    int c, n, nnodes = 0, nsepspecs = 0;
+    FILE *out;
+
+    /* At most one separator specification per argument */
+    sepspecs = malloc(sizeof(char *) * argc);
+    if (sepspecs == NULL) {
+	fprintf(stderr, "Unable to allocate memory for separators.\n");
+	return EXIT_FAILURE;
+    }
+
+    while ((c = ultragetopt(argc, argv, "o:p:s:")) != -1) {
+	switch (c) {
+	    case 'o':
+		outname = ultraoptarg;
+		break;
+	    case 'p':
+		prefix = ultraoptarg;
+		break;
+	    case 's':
+		sepspecs[nsepspecs++] = ultraoptarg;
+		break;
+	    default:
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+    }
+
+    if (argc - ultraoptind != 2) {
+	usage(argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    /* Keep an unmodified copy of the specification for the output */
+    longspec = malloc(strlen(argv[ultraoptind+1]) + 1);
+    if (longspec == NULL) {
+	fprintf(stderr, "Unable to allocate memory for long options.\n");
+	return EXIT_FAILURE;
+    }
+    strcpy(longspec, argv[ultraoptind+1]);
+
+    opts = parse_longopts(argv[ultraoptind+1], &n);
+    if (opts == NULL || check_duplicates(opts, n) != 0)
+	return EXIT_FAILURE;
+
+    for (c=0; c<256; c++)
+	shortseps[c] = NULL;
+    if (apply_seps(sepspecs, nsepspecs, argv[ultraoptind], shortseps, opts,
+		   n) != 0)
+	return EXIT_FAILURE;
+
+    if (n > 0) {
+	disp = malloc(sizeof(int) * n);
+	slots = malloc(sizeof(int) * n);
+	if (disp == NULL || slots == NULL) {
+	    fprintf(stderr, "Unable to allocate memory for hash table.\n");
+	    return EXIT_FAILURE;
+	}
+
+	if (build_hash(opts, n, disp, slots) != 0)
+	    return EXIT_FAILURE;
+
+	len = 1;
+	for (c=0; c<n; c++)
+	    len += opts[c].len;
+	trie = malloc(sizeof(*trie) * (2 * n + 1));
+	trielabels = malloc(len);
+	if (trie == NULL || trielabels == NULL) {
+	    fprintf(stderr, "Unable to allocate memory for trie.\n");
+	    return EXIT_FAILURE;
+	}
+
+	nnodes = build_trie(opts, n, trie, trielabels);
+	if (nnodes < 0)
+	    return EXIT_FAILURE;
+    }
+
+    if (outname != NULL) {
+	out = fopen(outname, "w");
+	if (out == NULL) {
+	    fprintf(stderr, "Unable to open %s: %s\n", outname,
+		    strerror(errno));
+	    return EXIT_FAILURE;
+	}
+    } else
+	out = stdout;
+
+    print_table(out, prefix, argv[ultraoptind], longspec, opts, n, disp,
+		slots, trie, nnodes, trielabels, shortseps);
+
+    if (fflush(out) != 0 || ferror(out)
+	|| (outname != NULL && fclose(out) != 0)) {
+	fprintf(stderr, "Error writing table: %s\n", strerror(errno));
+	return EXIT_FAILURE;
+    }
+
+    free(longspec);
+    free(sepspecs);
+    free(opts);
+    free(disp);
+    free(slots);
+    free(trie);
+    free(trielabels);
+
+    return EXIT_SUCCESS;
+}
+
+/* vim:set sts=4 sw=4: */
@@ -28,6 +28,7 @@
 
 #include <assert.h>
 #include <ctype.h>	/* islower() isupper() tolower() toupper() */
+#include <limits.h>	/* CHAR_BIT UCHAR_MAX */
 #include <stdarg.h>
 #include <stdio.h>	/* fprintf() */
 #include <stdlib.h>	/* getenv() */
@@ -37,6 +38,21 @@
 # include <strings.h>	/* strcasecmp(), strncasecmp() */
 #endif
 
+#if HAVE_SYS_MMAN_H && HAVE_MMAP
+# include <fcntl.h>	/* open() */
+# include <sys/mman.h>	/* mmap(), munmap() */
+# include <sys/stat.h>	/* fstat() */
+# include <unistd.h>	/* close(), sysconf() */
+#endif
+
+#if HAVE_PTHREAD
+# include <pthread.h>	/* pthread_create(), pthread_join() */
+#endif
+
+#if HAVE_UNISTD_H && HAVE_SYSCONF
+# include <unistd.h>	/* sysconf() */
+#endif
+
 #undef ULTRAGETOPT_REPLACE_GETOPT   /* Protect against project-wide defines */
 #include "ultragetopt.h"
 
@@ -84,6 +100,8 @@
  * ULTRAGETOPT_NO_OPTIONALARG	Do not support GNU "::" optional argument
  *				Always supported in *_long*()
  * ULTRAGETOPT_NO_OPTIONASSIGN	Do not support --option=value syntax
+ * ULTRAGETOPT_THREAD_LOCAL	Make ultraoptarg, ultraoptind, etc. thread-local
+ *				Callers must define it too (see ultragetopt.h)
  */
 
 #ifdef ULTRAGETOPT_LIKE_POSIX
@@ -219,37 +237,102 @@ static const char *const erroroptc =
     "%s: illegal option -- %c\n";
 #endif
 
+/* Errors for violated constraints (which no system getopt() checks) */
+static const char *const errorconflict =
+    "%s: options %s%s and %s%s can not be used together\n";
+static const char *const errorrequire =
+    "%s: option %s%s requires %s%s\n";
+static const char *const errornone =
+    "%s: one of the options %s is required\n";
+
+/* Errors in configuration files (which no system getopt() reads) */
+static const char *const errorfilearg =
+    "%s:%d: option %.*s does not take a value\n";
+static const char *const errorfilenoarg =
+    "%s:%d: option %.*s requires a value\n";
+static const char *const errorfileopt =
+    "%s:%d: unknown option %.*s\n";
+
 /* Globals to match optarg, optind, opterr, optopt, optreset */
-char *ultraoptarg = NULL;
-int ultraoptind = 1;
-int ultraopterr = 1;
-int ultraoptreset = 0;
+ULTRAGETOPT_TLS char *ultraoptarg = NULL;
+ULTRAGETOPT_TLS int ultraoptind = 1;
+ULTRAGETOPT_TLS int ultraopterr = 1;
+ULTRAGETOPT_TLS int ultraoptreset = 0;
 #ifdef ULTRAGETOPT_DEFAULTOPTOPT
-int ultraoptopt = ULTRAGETOPT_DEFAULTOPTOPT -0;
+ULTRAGETOPT_TLS int ultraoptopt = ULTRAGETOPT_DEFAULTOPTOPT -0;
+#else
+ULTRAGETOPT_TLS int ultraoptopt = 0;
+#endif
+
+ULTRAGETOPT_TLS struct ultragetopt_occurrences *ultraoptoccur = NULL;
+ULTRAGETOPT_TLS const char *ultraoptseps = NULL;
+ULTRAGETOPT_TLS struct ultragetopt_trace *ultraopttrace = NULL;
+ULTRAGETOPT_TLS struct ultragetopt_classes *ultraoptclasses = NULL;
+ULTRAGETOPT_TLS struct ultragetopt_constraints *ultraoptconstraints = NULL;
+ULTRAGETOPT_TLS struct ultragetopt_values *ultraoptvalues = NULL;
+
+/* How many options of the current multi-option argument have been processed?
+ * (e.g. -vvv) */
+static ULTRAGETOPT_TLS int ultraoptnum = 0;
+
+/* The parser core is inlined into one function for each set of flags (most
+ * ultragetopt*() functions) so that it is specialized for the constant flags,
+ * assigners, and leaders of that set
+ */
+#if defined(__GNUC__) \
+    && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ > 0))
+# define ALWAYS_INLINE	inline __attribute__ ((always_inline))
+#elif defined(_MSC_VER)
+# define ALWAYS_INLINE	__forceinline
 #else
-int ultraoptopt = 0;
+# define ALWAYS_INLINE	inline
 #endif
 
-static int ultraoptnum = 0; /* How many options of the current multi-option
-			       argument have been processed?  (e.g. -vvv) */
+/* Functions sharing one specialized copy of the parser call it through a
+ * function which must not be inlined back into each of them
+ */
+#if defined(__GNUC__) \
+    && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ > 0))
+# define NEVER_INLINE	__attribute__ ((noinline))
+#elif defined(_MSC_VER)
+# define NEVER_INLINE	__declspec(noinline)
+#else
+# define NEVER_INLINE
+#endif
 
 /* Add format error checking for gcc versions that support it */
 #if defined(__GNUC__) && __GNUC__ > 2 || (__GNUC__ == 2 && __GNUC_MINOR > 6)
-static void print_error(int flags, const char *template, ...)
-    __attribute__ ((format (printf, 2, 3)));
+static void print_error(int opterr, int flags, const char *template, ...)
+    __attribute__ ((format (printf, 3, 4)));
 #endif
 
 /* Print errors only if not suppressed */
-static void print_error(int flags, const char *template, ...)
+static void print_error(int opterr, int flags, const char *template, ...)
 {
     va_list ap;
 
     va_start(ap, template);
-    if (ultraopterr != 0 && !(flags & UGO_NOPRINTERR))
+    if (opterr != 0 && !(flags & UGO_NOPRINTERR))
 	vfprintf(stderr, template, ap);
     va_end(ap);
 }
 
+/* Record an event in the trace of state, if it has one */
+static inline void trace_event(const struct ultragetopt_state *state,
+			       int kind, int index, int value)
+{
+    struct ultragetopt_trace *trace = state->trace;
+    struct ultragetopt_event *event;
+
+    if (trace == NULL || trace->events == NULL)
+	return;
+
+    event = &trace->events[trace->next++ & trace->mask];
+    event->kind = (unsigned char)kind;
+    event->index = index;
+    event->value = value;
+}
+
 /* Check if an argument string looks like an option string */
 static inline int like_option(const char *arg, const char *optleaders)
 {
@@ -280,30 +363,322 @@ static inline int like_optarg(const char *arg, const char *optleaders,
 	    (!like_option(arg, optleaders) && !like_optterm(arg, optleaders)));
 }
 
+/* Record in the trace of state how arg (argv[index]) was classified */
+static inline void trace_classify(const struct ultragetopt_state *state,
+				  int index, const char *arg,
+				  const char *optleaders)
+{
+    int kind;
+
+    if (state->trace == NULL)
+	return;
+
+    if (like_option(arg, optleaders))
+	kind = UGO_TRACE_ISOPTION;
+    else if (like_optterm(arg, optleaders))
+	kind = UGO_TRACE_ISTERMINATOR;
+    else
+	kind = UGO_TRACE_ISOPERAND;
+
+    trace_event(state, UGO_TRACE_CLASSIFY, index, kind);
+}
+
+/* Record in the trace of state the result ret of a call to the parser */
+static void trace_result(const struct ultragetopt_state *state,
+			 char *const argv[], int ret)
+{
+    if (ret == -1) {
+	trace_event(state, UGO_TRACE_END, state->optind, 0);
+	return;
+    }
+
+    /* Errors have no name, non-options were traced when classified */
+    if (state->optname == NULL) {
+	if (ret == '?' || ret == ':')
+	    trace_event(state, UGO_TRACE_ERROR, state->curind, ret);
+	return;
+    }
+
+    if (state->longind >= 0)
+	trace_event(state, UGO_TRACE_LONG, state->curind, state->longind);
+    else
+	trace_event(state, UGO_TRACE_SHORT, state->curind, ret);
+
+    if (state->optarg == NULL)
+	return;
+
+    if (state->optarg == argv[state->curind+1])
+	trace_event(state, UGO_TRACE_ARGUMENT, state->curind+1, 0);
+    else
+	trace_event(state, UGO_TRACE_ARGUMENT, state->curind,
+		    (int)(state->optarg - argv[state->curind]));
+}
+
+/* Compare option names, ignoring case if requested by flags */
+static ALWAYS_INLINE int optncmp(const char *s1, const char *s2, size_t n,
+				 int flags)
+{
+    if (flags & UGO_CASEINSENSITIVE)
+	return strncasecmp(s1, s2, n);
+    else
+	return strncmp(s1, s2, n);
+}
+
+/* Length of the name of long option i */
+static inline size_t longopt_namelen(const struct ultragetopt_table *opts,
+				     int i)
+{
+    if (opts->namelens != NULL)
+	return opts->namelens[i];
+    if (opts->packed != NULL)
+	return opts->packed->lengths[i];
+
+    return strlen(opts->longopts[i].name);
+}
+
+/* Name of long option i */
+static ALWAYS_INLINE const char *longopt_name(
+	const struct ultragetopt_table *opts, int i)
+{
+    if (opts->packed != NULL)
+	return opts->packed->pool + opts->packed->offsets[i];
+
+    return opts->longopts[i].name;
+}
+
+/* has_arg of long option i */
+static ALWAYS_INLINE int longopt_hasarg(const struct ultragetopt_table *opts,
+					int i)
+{
+    if (opts->packed != NULL)
+	return opts->packed->hasargs[i];
+
+    return opts->longopts[i].has_arg;
+}
+
+/* flag of long option i */
+static ALWAYS_INLINE int *longopt_flag(const struct ultragetopt_table *opts,
+				       int i)
+{
+    if (opts->packed != NULL)
+	return opts->packed->flags != NULL ? opts->packed->flags[i] : NULL;
+
+    return opts->longopts[i].flag;
+}
+
+/* val of long option i */
+static ALWAYS_INLINE int longopt_val(const struct ultragetopt_table *opts,
+				     int i)
+{
+    if (opts->packed != NULL)
+	return opts->packed->vals[i];
+
+    return opts->longopts[i].val;
+}
+
+/* Find the packed long option named by the first len characters of name
+ * Returns its index, or -1 if there is none
+ */
+static ALWAYS_INLINE int packed_longopt(
+	const struct ultragetopt_packed *packed, const char *name,
+	size_t len, int flags)
+{
+    unsigned int hash = (unsigned int)ultragetopt_hash(name, len, 0);
+    unsigned long i;
+
+    /* The hash is case-folded, so this finds names differing in case */
+    for (i = hash & packed->slotmask; packed->slots[i].longind != 0;
+	 i = (i + 1) & packed->slotmask) {
+	int longind = (int)packed->slots[i].longind - 1;
+
+	if (packed->slots[i].hash == hash
+	    && packed->lengths[longind] == len
+	    && optncmp(name, packed->pool + packed->offsets[longind], len,
+		       flags) == 0)
+	    return longind;
+    }
+
+    return -1;
+}
+
+/* Walk the trie of long names along the first len characters of name (or
+ * up to its NUL terminator if len is (size_t)-1)
+ * Returns the index of the long option with the longest name which is a
+ * prefix of name, setting *matchlen to its length, or -1 if there is none.
+ * If exact, only a long option named by all len characters is returned.
+ */
+static ALWAYS_INLINE int trie_longopt(const struct ultragetopt_table *opts,
+				      const char *name, size_t len,
+				      int exact, int flags, size_t *matchlen)
+{
+    const struct ultragetopt_trienode *node = opts->trie;
+    size_t pos = 0;
+    int match = -1;
+
+    for (;;) {
+	const struct ultragetopt_trienode *child;
+	const char *label;
+	int c, i;
+
+	/* Edges are case-folded, so check case here if it matters */
+	if (node->longind >= 0
+	    && (!exact || pos == len)
+	    && ((flags & UGO_CASEINSENSITIVE)
+		|| strncmp(name, opts->longopts[node->longind].name, pos)
+		   == 0)) {
+	    match = node->longind;
+	    *matchlen = pos;
+	}
+
+	if (pos == len || name[pos] == '\0')
+	    break;
+
+	c = tolower((unsigned char)name[pos]);
+	child = &opts->trie[node->child];
+	for (i=0; i<node->nchildren; i++, child++)
+	    if (opts->trielabels[child->label] == c)
+		break;
+	if (i == node->nchildren)
+	    break;
+
+	label = opts->trielabels + child->label;
+	for (i=1; i<child->labellen; i++)
+	    if (pos+i == len
+		|| tolower((unsigned char)name[pos+i]) != label[i])
+		return match;
+
+	pos += child->labellen;
+	node = child;
+    }
+
+    return match;
+}
+
+/* Find the long option named by the first len characters of name
+ * Returns its index in opts->longopts, or -1 if there is none
+ */
+static ALWAYS_INLINE int find_longopt(const struct ultragetopt_table *opts,
+				       const char *name, size_t len,
+				       int flags)
+{
+    int i;
+
+    if (opts->packed != NULL)
+	return packed_longopt(opts->packed, name, len, flags);
+
+    /* Use the perfect hash, if we have one */
+    if (opts->hashslots != NULL) {
+	int disp;
+
+	if (opts->nlongopts <= 0)
+	    return -1;
+
+	disp = opts->hashdisp[ultragetopt_hash(name, len, 0)
+			      % opts->nlongopts];
+	if (disp < 0)
+	    i = opts->hashslots[-disp - 1];
+	else
+	    i = opts->hashslots[ultragetopt_hash(name, len, disp)
+				% opts->nlongopts];
+
+	if (longopt_namelen(opts, i) == len
+	    && optncmp(name, opts->longopts[i].name, len, flags) == 0)
+	    return i;
+
+	return -1;
+    }
+
+    if (opts->trie != NULL) {
+	size_t matchlen;
+
+	return trie_longopt(opts, name, len, 1, flags, &matchlen);
+    }
+
+    for (i=0; opts->longopts[i].name != NULL; i++)
+	if (optncmp(name, opts->longopts[i].name, len, flags) == 0
+	    && longopt_namelen(opts, i) == len)
+	    return i;
+
+    return -1;
+}
+
+/* Find short option c
+ * Returns the option character as it appears in the option set (which
+ * differs from c when matched case-insensitively) and sets *has_arg, or
+ * returns 0 if c is not an option
+ */
+static ALWAYS_INLINE int find_shortopt(const struct ultragetopt_table *opts,
+				       int c, int flags, int *has_arg)
+{
+    const char *optpos;
+
+    if (c == ':' || c == '\0')
+	return 0;
+
+    /* Use the dispatch table, if we have one */
+    if (opts->shortargs != NULL) {
+	int found = opts->shortargs[(unsigned char)c];
+
+	if (!found && (flags & UGO_CASEINSENSITIVE)) {
+	    if (islower((unsigned char)c))
+		c = toupper((unsigned char)c);
+	    else
+		c = tolower((unsigned char)c);
+	    found = opts->shortargs[(unsigned char)c];
+	}
+
+	if (!found)
+	    return 0;
+
+	*has_arg = found - 1;
+	return c;
+    }
+
+    if (opts->shortopts == NULL)
+	return 0;
+
+    optpos = strchr(opts->shortopts, c);
+    if (optpos == NULL && (flags & UGO_CASEINSENSITIVE)) {
+	if (islower((unsigned char)c))
+	    optpos = strchr(opts->shortopts, toupper((unsigned char)c));
+	else
+	    optpos = strchr(opts->shortopts, tolower((unsigned char)c));
+    }
+
+    if (optpos == NULL)
+	return 0;
+
+    if (optpos[1] != ':')
+	*has_arg = no_argument;
+    else if (optpos[2] != ':')
+	*has_arg = required_argument;
+    else
+	*has_arg = optional_argument;
+
+    return optpos[0];
+}
+
 /* If argv[curopt] matches a long option, return the index of that option
  * Otherwise, return -1
  * If it has an adjacent argument, return pointer to it in longarg, else NULL
  */
-static int match_longopt(int curopt, char *const argv[],
-			 const struct option *longopts, const char *assigners,
-			 const char *optleaders, int flags, char **longarg)
+static ALWAYS_INLINE int match_longopt(int curopt, char *const argv[],
+				       const struct ultragetopt_table *opts,
+				       const char *assigners,
+				       const char *optleaders, int flags,
+				       char **longarg)
 {
+    const struct option *longopts = opts->longopts;
     size_t alen, optnamelen = 0;
     char *optname;
     char *temp;
     int i;
-    int (*optncmp)(const char *s1, const char *s2, size_t n);
 
     if (longarg == NULL)
 	longarg = &temp;
     *longarg = NULL;
 
-    if (flags & UGO_CASEINSENSITIVE)
-	optncmp = strncasecmp;
-    else
-	optncmp = strncmp;
-
-    if (longopts == NULL)
+    if (longopts == NULL && opts->packed == NULL)
 	return -1;
 
     if (!like_option(argv[curopt], optleaders))
@@ -325,12 +700,31 @@ static int match_longopt(int curopt, char *const argv[],
     if (flags & UGO_LONGOPTADJACENT) {
 	size_t matchlen = 0;
 	int matchind = -1;
-	for (i=0; longopts[i].name != NULL; i++) {
-	    size_t longnamelen = strlen(longopts[i].name);
-	    if (longnamelen > matchlen
-		&& optncmp(optname, longopts[i].name, longnamelen) == 0) {
-		matchind = i;
-		matchlen = longnamelen;
+
+	if (opts->trie != NULL) {
+	    /* Single walk along optname */
+	    matchind = trie_longopt(opts, optname, (size_t)-1, 0, flags,
+				    &matchlen);
+	} else if (opts->packed != NULL) {
+	    /* Longest prefix first, a hash lookup each */
+	    size_t len;
+
+	    for (len=strlen(optname); len > 0; len--) {
+		matchind = packed_longopt(opts->packed, optname, len, flags);
+		if (matchind >= 0) {
+		    matchlen = len;
+		    break;
+		}
+	    }
+	} else {
+	    for (i=0; longopts[i].name != NULL; i++) {
+		size_t longnamelen = longopt_namelen(opts, i);
+		if (longnamelen > matchlen
+		    && optncmp(optname, longopts[i].name, longnamelen,
+			       flags) == 0) {
+		    matchind = i;
+		    matchlen = longnamelen;
+		}
 	    }
 	}
 
@@ -364,20 +758,13 @@ static int match_longopt(int curopt, char *const argv[],
     if (optnamelen == 0)
 	optnamelen = strlen(optname);
 
-    for (i=0; longopts[i].name != NULL; i++)
-	if (optncmp(optname, longopts[i].name, optnamelen) == 0
-	    && strlen(longopts[i].name) == optnamelen)
-	    return i;
-
-    return -1;
+    return find_longopt(opts, optname, optnamelen, flags);
 }
 
 /* Check if an option has a separate argument (in the following argv[] index) */
-static int has_separate_argument(int curopt, int argc, char *const argv[],
-				 const char *shortopts,
-				 const struct option *longopts,
-				 const char *assigners, const char *optleaders,
-				 int flags)
+static ALWAYS_INLINE int has_separate_argument(int curopt, int argc,
+	char *const argv[], const struct ultragetopt_table *opts,
+	const char *assigners, const char *optleaders, int flags)
 {
     int longind;
     char *longarg;
@@ -385,58 +772,73 @@ static int has_separate_argument(int curopt, int argc, char *const argv[],
     assert(curopt < argc && like_option(argv[curopt], optleaders));
 
     /* Check if we have a long option */
-    longind = match_longopt(ultraoptind, argv, longopts, assigners, optleaders,
+    longind = match_longopt(curopt, argv, opts, assigners, optleaders,
 			    flags, &longarg);
     if (longind >= 0) {
-	if (longopts[longind].has_arg == no_argument
+	int has_arg = longopt_hasarg(opts, longind);
+
+	if (has_arg == no_argument
 	    || longarg != NULL
-	    || (longopts[longind].has_arg == optional_argument
+	    || (has_arg == optional_argument
 		&& !(flags & UGO_SEPARATEDOPTIONAL)))
 	    return 0;
 
 	return like_optarg(argv[curopt+1], optleaders,
-		    (flags & UGO_HYPHENARG) &&
-		    longopts[longind].has_arg == required_argument);
+		    (flags & UGO_HYPHENARG) && has_arg == required_argument);
     } else if (!strchr(optleaders, argv[curopt][1])) {
 	/* Short option */
-	char *optpos;
+	int has_arg;
 
-	optpos = strchr(shortopts, argv[curopt][1]);
-	if ((flags & UGO_CASEINSENSITIVE) && optpos == NULL) {
-	    if (islower(argv[curopt][1]))
-		optpos = strchr(shortopts, toupper(argv[curopt][1]));
-	    else
-		optpos = strchr(shortopts, tolower(argv[curopt][1]));
-	}
-
-	
-	return optpos != NULL			/* Option found */
-	       && optpos[1] == ':'		/* Option takes argument */
-	       && (optpos[2] != ':' || (flags & UGO_SEPARATEDOPTIONAL))
+	return find_shortopt(opts, argv[curopt][1], flags, &has_arg)
+	       && has_arg != no_argument	/* Option takes argument */
+	       && (has_arg != optional_argument
+		   || (flags & UGO_SEPARATEDOPTIONAL))
 	       && argv[curopt][2] == '\0'	/* Argument is not adjacent */
 	       && like_optarg(argv[curopt+1],	/* Is an argument */
 		    optleaders,
-		    (flags & UGO_HYPHENARG) && optpos[2] != ':');
+		    (flags & UGO_HYPHENARG) && has_arg != optional_argument);
     }
 
     /* No match */
     return 0;
 }
 
-/* Bring the next option, or terminator, up to ultraoptind if there is one
+/* Skip the entries of classes before argv[index] */
+static inline void classes_skip(struct ultragetopt_classes *classes, int index)
+{
+    while (classes->next < classes->noptions
+	   && classes->options[classes->next] < index)
+	classes->next++;
+}
+
+/* Bring the next option, or terminator, up to state->optind if there is one
  * Returns number of words shifted forward
  */
-static int permute_options(int argc, char *argv[], const char *shortopts,
-			   const struct option *longopts,
-			   const char *assigners, const char *optleaders,
-			   int flags)
+static ALWAYS_INLINE int permute_options(struct ultragetopt_state *state,
+					 int argc, char *argv[],
+					 const struct ultragetopt_table *opts,
+					 const char *assigners,
+					 const char *optleaders, int flags)
 {
-    int curopt = ultraoptind;
+    struct ultragetopt_classes *classes = state->classes;
+    int curopt = state->optind;
 
     /* If we already have an option or no more possible, give up */
     if (curopt >= argc || like_option(argv[curopt], optleaders))
 	return 0;
 
+    /* Classes made for another argv would skip over its options */
+    if (classes != NULL && classes->argc != argc)
+	classes = NULL;
+
+    /* Go straight to the next option, if we know where it is */
+    if (classes != NULL) {
+	classes_skip(classes, curopt);
+	if (classes->next == classes->noptions)
+	    return 0;
+	curopt = classes->options[classes->next];
+    }
+
     for ( ; curopt < argc && argv[curopt]; curopt++) {
 	int shiftarg = 0;
 	int i;
@@ -444,15 +846,23 @@ static int permute_options(int argc, char *argv[], const char *shortopts,
 	/* Permute options and the option terminator */
 	if (like_option(argv[curopt], optleaders)) {
 	    /* Check if we need to shift argument too */
-	    shiftarg = has_separate_argument(curopt, argc, argv, shortopts,
-					     longopts, assigners, optleaders,
-					     flags);
+	    shiftarg = has_separate_argument(curopt, argc, argv, opts,
+					     assigners, optleaders, flags);
 	} else if (!like_optterm(argv[curopt], optleaders)) {
 	    continue;
 	}
 
+	/* Everything up to the words moved has been looked at (which is the
+	 * fix-up for an argument classified apart from its option) */
+	if (classes != NULL)
+	    classes_skip(classes, curopt + shiftarg + 1);
+
+	trace_event(state, UGO_TRACE_PERMUTE, curopt, state->optind);
+	if (shiftarg)
+	    trace_event(state, UGO_TRACE_PERMUTE, curopt+1, state->optind+1);
+
 	/* Shift option */
-	for (i=curopt; i>ultraoptind; i--) {
+	for (i=curopt; i>state->optind; i--) {
 	    char *temp = argv[i];
 	    argv[i] = argv[i-1];
 	    argv[i-1] = temp;
@@ -475,312 +885,840 @@ static int permute_options(int argc, char *argv[], const char *shortopts,
     return 0;
 }
 
-/* Handle a longopts[longind] matches argv[ultraoptind] actions */
-static int handle_longopt(int longind, char *longarg, int noseparg,
-			  char *const argv[],
-			  const struct option *longopts, int *indexptr,
-			  const char *optleaders, int flags)
+/* Bits in each unsigned long of a constraint bitset */
+#define WORDBITS ((int)(sizeof(unsigned long) * CHAR_BIT))
+
+/* Record that the option with constraint bit was given */
+static inline void constraint_seen(struct ultragetopt_constraints *constraints,
+				   int bit)
 {
-    /* Handle assignment arguments */
-    if (longarg && longopts[longind].has_arg == no_argument) {
-	print_error(flags, errorarg, argv[0],
-		    longarg-argv[ultraoptind]-1, argv[ultraoptind]);
-	/* TODO:  What is a good value to put in ultraoptopt? */
-	/* Looks like GNU getopt() uses val */
-	ultraoptopt = longopts[longind].val;
-	ultraoptind++;
-	return '?';
-    } else if (longarg) {
-	ultraoptind++;
-	ultraoptarg = longarg;
+    if (bit >= 0)
+	constraints->seen[bit / WORDBITS] |= 1UL << (bit % WORDBITS);
+}
 
-	if (indexptr)
-	    *indexptr = longind;
+/* Block of arena memory allocated by the library, its data follows */
+struct arena_block {
+    struct arena_block *next;
+};
 
-	if (longopts[longind].flag) {
-	    *(longopts[longind].flag) = longopts[longind].val;
-	    return 0;
-	} else
-	    return longopts[longind].val;
+/* Smallest data size of an arena block */
+#define ARENA_MINBLOCK 4096
+
+/* Allocate size bytes (aligned for pointers) from the arena of values
+ * Returns the memory, or NULL if it could not be allocated
+ */
+static void *arena_alloc(struct ultragetopt_values *values, size_t size)
+{
+    size_t start = (values->arenaused + sizeof(char *) - 1)
+	& ~(sizeof(char *) - 1);
+    struct arena_block *block;
+    size_t blocksize;
+
+    if (values->arena != NULL && start <= values->arenasize
+	&& size <= values->arenasize - start) {
+	values->arenaused = start + size;
+	return values->arena + start;
     }
 
-    /* Handle missing required argument */
-    if (longopts[longind].has_arg == required_argument
-	&& (noseparg
-	    || !like_optarg(argv[ultraoptind+1],
-		    optleaders,
-		    flags & UGO_HYPHENARG))) {
-	print_error(flags, errornoarg, argv[0],
-		    strlen(argv[ultraoptind]), argv[ultraoptind]);
-	ultraoptind++;
-	if (flags & UGO_MISSINGCOLON)
-	    return ':';
-	else
-	    return '?';
+    /* Blocks double in size, so there are few of them */
+    blocksize = values->blocks != NULL ? 2 * values->arenasize
+	: ARENA_MINBLOCK;
+    if (blocksize < size)
+	blocksize = size;
+    block = malloc(sizeof(*block) + blocksize);
+    if (block == NULL)
+	return NULL;
+
+    block->next = values->blocks;
+    values->blocks = block;
+    values->arena = (char *)(block + 1);
+    values->arenasize = blocksize;
+    values->arenaused = size;
+    return values->arena;
+}
+
+/* Append the argument of the current option to list (if any) */
+static void accumulate_value(struct ultragetopt_state *state, int list)
+{
+    struct ultragetopt_values *values = state->values;
+    struct ultragetopt_valuelist *valuelist;
+
+    if (list < 0 || state->optarg == NULL)
+	return;
+
+    valuelist = &values->lists[list];
+    if (valuelist->count == valuelist->size) {
+	int size = valuelist->size > 0 ? 2 * valuelist->size : 8;
+	char **grown;
+
+	/* The old array stays in the arena, at most half the space used */
+	grown = arena_alloc(values, (size_t)size * sizeof(char *));
+	if (grown == NULL) {
+	    values->failed = 1;
+	    return;
+	}
+	if (valuelist->count > 0)
+	    memcpy(grown, valuelist->values,
+		   (size_t)valuelist->count * sizeof(char *));
+	valuelist->values = grown;
+	valuelist->size = size;
     }
 
-    /* Handle available argument */
-    if ((longopts[longind].has_arg == required_argument
-	 || (longopts[longind].has_arg == optional_argument
-	     && (flags & UGO_SEPARATEDOPTIONAL)))
-	&& !noseparg
-	&& like_optarg(argv[ultraoptind+1],
-		optleaders,
-		(flags & UGO_HYPHENARG) &&
-		longopts[longind].has_arg == required_argument)) {
-	ultraoptarg = argv[ultraoptind+1];
-	ultraoptind += 2;
-    } else
-	ultraoptind++;
+    valuelist->values[valuelist->count++] = state->optarg;
+}
+
+/* Record an occurrence of an option at argv[curind] */
+static void record_occurrence(struct ultragetopt_state *state,
+			      struct ultragetopt_occurrence *occ, int curind)
+{
+    if (occ->count++ == 0)
+	occ->first = curind;
+    occ->last = curind;
+    occ->arg = state->optarg;
+}
+
+/* Short option which long option longind is an alias of, or 0
+ * As for {"verbose", no_argument, NULL, 'v'} with 'v' in shortopts, the
+ * long option has no flag and returns the character of a short option.
+ * Occurrences of both are recorded together, under the short option.
+ */
+static int longopt_alias(const struct ultragetopt_table *opts, int longind)
+{
+    int val = longopt_val(opts, longind);
+    int has_arg;
+
+    if (longopt_flag(opts, longind) != NULL || val <= 0 || val > UCHAR_MAX)
+	return 0;
+
+    return find_shortopt(opts, val, 0, &has_arg) == val ? val : 0;
+}
+
+/* Record that short option c was found at opt in argv[state->curind]
+ * Returns c
+ */
+static int found_shortopt(struct ultragetopt_state *state,
+			  const struct ultragetopt_table *opts, int c,
+			  char *opt)
+{
+    state->optname = opt;
+    if (opts->shortseps != NULL)
+	state->optseps = opts->shortseps[(unsigned char)c];
+    if (state->constraints != NULL)
+	constraint_seen(state->constraints,
+			state->constraints->shortbits[(unsigned char)c]);
+    if (state->values != NULL)
+	accumulate_value(state, state->values->shortlists[(unsigned char)c]);
+
+    if (state->occurrences != NULL)
+	record_occurrence(state,
+			  &state->occurrences->shortopts[(unsigned char)c],
+			  state->curind);
+
+    return c;
+}
+
+/* Record that long option longind was found at argv[state->curind]
+ * Returns the value for the getopt functions to return
+ */
+static int found_longopt(struct ultragetopt_state *state,
+			 const struct ultragetopt_table *opts, int longind,
+			 int *indexptr)
+{
+    int *flag;
+
+    state->longind = longind;
+    state->optname = (char *)longopt_name(opts, longind);
+    if (opts->longseps != NULL)
+	state->optseps = opts->longseps[longind];
+    if (state->constraints != NULL
+	&& longind < state->constraints->nlongopts)
+	constraint_seen(state->constraints, longind);
+    if (state->values != NULL && longind < state->values->nlongopts)
+	accumulate_value(state, state->values->longlists[longind]);
+
+    if (state->occurrences != NULL) {
+	int c = longopt_alias(opts, longind);
+
+	if (c != 0)
+	    record_occurrence(state, &state->occurrences->shortopts[c],
+			      state->curind);
+	else if (longind < state->occurrences->nlongopts)
+	    record_occurrence(state, &state->occurrences->longopts[longind],
+			      state->curind);
+    }
 
     if (indexptr)
 	*indexptr = longind;
 
-    if (longopts[longind].flag) {
-	*(longopts[longind].flag) = longopts[longind].val;
+    flag = longopt_flag(opts, longind);
+    if (flag) {
+	*flag = longopt_val(opts, longind);
 	return 0;
     } else
-	return longopts[longind].val;
+	return longopt_val(opts, longind);
 }
 
-int ultragetopt_tunable(int argc, char *const argv[], const char *shortopts,
-			const struct option *longopts, int *indexptr,
-			const char *assigners, const char *optleaders,
-			int flags)
+/* Handle a longopts[longind] matches argv[state->optind] actions */
+static ALWAYS_INLINE int handle_longopt(struct ultragetopt_state *state,
+					int longind, char *longarg,
+					int noseparg, char *const argv[],
+					const struct ultragetopt_table *opts,
+					int *indexptr, const char *optleaders,
+					int flags)
 {
-    char *opt;		/* Option we are processing */
-    char *optpos;	/* Pointer to opt in shortopts */
-    int noseparg = 0;	/* Force option not to have a separate argument */
+    int has_arg = longopt_hasarg(opts, longind);
 
-    if (ultraoptreset) {
-	ultraoptind = 1;
-	ultraopterr = 1;
-	ultraoptnum = 0;
-	ultraoptreset = 0;
+    /* Handle assignment arguments */
+    if (longarg && has_arg == no_argument) {
+	print_error(state->opterr, flags, errorarg, argv[0],
+		    longarg-argv[state->optind]-1, argv[state->optind]);
+	/* TODO:  What is a good value to put in state->optopt? */
+	/* Looks like GNU getopt() uses val */
+	state->optopt = longopt_val(opts, longind);
+	state->optind++;
+	return '?';
     }
 
-    ultraoptarg = NULL;
-#ifdef ULTRAGETOPT_DEFAULTOPTOPT
-    ultraoptopt = ULTRAGETOPT_DEFAULTOPTOPT -0;
-#endif
+    if (longarg) {
+	state->optind++;
+	state->optarg = longarg;
+    } else if (has_arg == required_argument
+	       && (noseparg
+		   || !like_optarg(argv[state->optind+1],
+			   optleaders,
+			   flags & UGO_HYPHENARG))) {
+	/* Handle missing required argument */
+	print_error(state->opterr, flags, errornoarg, argv[0],
+		    strlen(argv[state->optind]), argv[state->optind]);
+	state->optind++;
+	if (flags & UGO_MISSINGCOLON)
+	    return ':';
+	else
+	    return '?';
+    } else if ((has_arg == required_argument
+		|| (has_arg == optional_argument
+		    && (flags & UGO_SEPARATEDOPTIONAL)))
+	       && !noseparg
+	       && like_optarg(argv[state->optind+1],
+		       optleaders,
+		       (flags & UGO_HYPHENARG) &&
+		       has_arg == required_argument)) {
+	/* Handle available argument */
+	state->optarg = argv[state->optind+1];
+	state->optind += 2;
+    } else
+	state->optind++;
 
-    /* Sanity check (These are specified verbatim in SUS) */
-    if (ultraoptind > argc
-	|| argv[ultraoptind] == NULL)
-	return -1;
+    return found_longopt(state, opts, longind, indexptr);
+}
 
+/* Flags which shortopts_flags() may change */
+#define SHORTOPTS_FLAGS \
+	(UGO_OPTIONPERMUTE | UGO_NONOPTARG | UGO_NOPRINTERR | UGO_MISSINGCOLON)
+
+/* Remove leading flag characters from *shortopts
+ * Returns flags updated according to those characters and the environment
+ */
+static ALWAYS_INLINE int shortopts_flags(const char **shortopts, int flags)
+{
     /* No permuting when $POSIXLY_CORRECT is set (to match GNU getopt) */
     if (getenv("POSIXLY_CORRECT"))
 	flags &= ~UGO_OPTIONPERMUTE;
 
     /* Get flags from shortopts */
-    for ( ; shortopts && *shortopts; shortopts++) {
-	if (*shortopts == '+')
+    for ( ; *shortopts && **shortopts; (*shortopts)++) {
+	if (**shortopts == '+')
 	    flags &= ~UGO_OPTIONPERMUTE;
-	else if (*shortopts == '-')
+	else if (**shortopts == '-')
 	    flags |= UGO_NONOPTARG;
-	else if (*shortopts == ':') {
+	else if (**shortopts == ':') {
 	    flags |= UGO_NOPRINTERR;
 	    flags |= UGO_MISSINGCOLON;
 	} else
 	    break;
     }
 
+    return flags;
+}
+
+/* Parser core, instantiated by getopt_instance()
+ * Leading flag characters must already be removed from opts->shortopts
+ */
+static ALWAYS_INLINE int getopt_table(struct ultragetopt_state *state,
+				      int argc, char *const argv[],
+				      const struct ultragetopt_table *opts,
+				      int *indexptr, const char *assigners,
+				      const char *optleaders, int flags)
+{
+    char *opt;		/* Option we are processing */
+    int optc;		/* Option character matching opt, or 0 */
+    int has_arg;	/* Does optc take an argument? */
+    int noseparg = 0;	/* Force option not to have a separate argument */
+
+    if (state->optreset) {
+	state->optind = 1;
+	state->opterr = 1;
+	state->optnum = 0;
+	state->optreset = 0;
+
+	/* Parsing starts over, and so does the walk through classes */
+	if (state->classes != NULL)
+	    state->classes->next = 0;
+    }
+
+    state->optarg = NULL;
+    state->longind = -1;
+    state->optname = NULL;
+    state->optseps = NULL;
+#ifdef ULTRAGETOPT_DEFAULTOPTOPT
+    state->optopt = ULTRAGETOPT_DEFAULTOPTOPT -0;
+#endif
+
+    /* Sanity check (These are specified verbatim in SUS) */
+    if (state->optind > argc
+	|| argv[state->optind] == NULL)
+	return -1;
+
+    if (state->optnum == 0)
+	trace_classify(state, state->optind, argv[state->optind], optleaders);
+
     /* Found non-option */
-    if (!like_option(argv[ultraoptind], optleaders)) {
+    if (!like_option(argv[state->optind], optleaders)) {
 	int shifted;
 
-	if (like_optterm(argv[ultraoptind], optleaders)) {
+	if (like_optterm(argv[state->optind], optleaders)) {
 	    if (!(flags & UGO_NOEATDASHDASH))
-		ultraoptind++;
+		state->optind++;
 
 	    return -1;
 	}
 
 	if (flags & UGO_NONOPTARG) {
-	    ultraoptarg = argv[ultraoptind];
-	    ultraoptind++;
+	    state->curind = state->optind;
+	    state->optarg = argv[state->optind];
+	    state->optind++;
 	    return 1;
 	}
 
 	if (!(flags & UGO_OPTIONPERMUTE))
 	    return -1;
 
-	shifted = permute_options(argc, (char **)argv, shortopts, longopts,
-				  assigners, optleaders, flags);
+	shifted = permute_options(state, argc, (char **)argv, opts, assigners,
+				  optleaders, flags);
 	if (shifted == 0)
 	    return -1;
 	else if (shifted == 1)
 	    noseparg = 1;
 
-	if (like_optterm(argv[ultraoptind], optleaders)) {
+	if (like_optterm(argv[state->optind], optleaders)) {
 	    if (!(flags & UGO_NOEATDASHDASH))
-		ultraoptind++;
+		state->optind++;
 
 	    return -1;
 	}
     }
 
     /* At this point we must have an option of some sort */
-    assert(like_option(argv[ultraoptind], optleaders));
+    assert(like_option(argv[state->optind], optleaders));
+    state->curind = state->optind;
 
     /* Handle --* */
-    if (argv[ultraoptind][0] == argv[ultraoptind][1]) {
+    if (argv[state->optind][0] == argv[state->optind][1]) {
 	int longind;
 	char *longarg;
 
 	/* Handle long option */
-	longind = match_longopt(ultraoptind, argv, longopts, assigners,
+	longind = match_longopt(state->optind, argv, opts, assigners,
 				optleaders, flags, &longarg);
 	if (longind < 0) {
 	    if (longarg == NULL)
-		print_error(flags, erroropt, argv[0],
-			    strlen(argv[ultraoptind]), argv[ultraoptind]);
+		print_error(state->opterr, flags, erroropt, argv[0],
+			    strlen(argv[state->optind]), argv[state->optind]);
 	    else
-		print_error(flags, erroropt, argv[0],
-			    longarg - argv[ultraoptind] - 1, argv[ultraoptind]);
+		print_error(state->opterr, flags, erroropt, argv[0],
+			    longarg - argv[state->optind] - 1, argv[state->optind]);
 
 	    /* TODO:  What is a good value for optopt in this case? */
 	    /*	      Looks like BSD uses 0 */
-	    ultraoptopt = 0;
-	    ultraoptind++;
+	    state->optopt = 0;
+	    state->optind++;
 	    return '?';
 	}
 
-	return handle_longopt(longind, longarg, noseparg, argv,
-			      longopts, indexptr, optleaders, flags);
+	return handle_longopt(state, longind, longarg, noseparg, argv,
+			      opts, indexptr, optleaders, flags);
     }
 
     /* See if it matches a long-only option */
-    if (longopts != NULL &&
-	    ultraoptnum == 0 &&
+    if ((opts->longopts != NULL || opts->packed != NULL) &&
+	    state->optnum == 0 &&
 	    ((flags & UGO_SINGLELEADERLONG) ||
 	     (flags & UGO_SINGLELEADERONLY))) {
 	int longind;
 	char *longarg;
 
-	longind = match_longopt(ultraoptind, argv, longopts, assigners,
+	longind = match_longopt(state->optind, argv, opts, assigners,
 				optleaders, flags, &longarg);
 
 	if (longind >= 0)
-	    return handle_longopt(longind, longarg, noseparg, argv,
-				  longopts, indexptr, optleaders, flags);
+	    return handle_longopt(state, longind, longarg, noseparg, argv,
+				  opts, indexptr, optleaders, flags);
     }
 
     /* No long matches, process short option */
-    opt = argv[ultraoptind] + ultraoptnum + 1;
-    optpos = strchr(shortopts, opt[0]);
-    if (optpos == NULL && (flags & UGO_CASEINSENSITIVE)) {
-	if (islower(opt[0]))
-	    optpos = strchr(shortopts, toupper(opt[0]));
-	else
-	    optpos = strchr(shortopts, tolower(opt[0]));
-    }
+    opt = argv[state->optind] + state->optnum + 1;
+    optc = find_shortopt(opts, opt[0], flags, &has_arg);
 
-    /* This could indicate ultraoptnum not being reset properly */
+    /* This could indicate state->optnum not being reset properly */
     assert(opt[0] != '\0');
 
     /* Check for invalid or unrecognized option */
-    if (optpos == NULL || opt[0] == ':') {
-	print_error(flags, erroroptc, argv[0], opt[0]);
+    if (optc == 0) {
+	print_error(state->opterr, flags, erroroptc, argv[0], opt[0]);
 
-	ultraoptopt = opt[0];
+	state->optopt = opt[0];
 	if (opt[1] != '\0')
-	    ultraoptnum++;
+	    state->optnum++;
 	else {
-	    ultraoptnum = 0;
-	    ultraoptind++;
+	    state->optnum = 0;
+	    state->optind++;
 	}
 
 	return '?';
     }
 
     /* Handle arguments */
-    if (optpos[1] == ':') {
-	ultraoptnum = 0;
+    if (has_arg != no_argument) {
+	state->optnum = 0;
 
 	/* Handle adjacent arguments -ofile.txt */
 	if (opt[1] != '\0') {
 	    /* Skip over assignment character */
 	    if ((flags & UGO_SHORTOPTASSIGN) && strchr(assigners, opt[1]))
-		ultraoptarg = opt + 2;
+		state->optarg = opt + 2;
 	    else
-		ultraoptarg = opt + 1;
+		state->optarg = opt + 1;
 
-	    ultraoptind++;
-	    return optpos[0];
+	    state->optind++;
+	    return found_shortopt(state, opts, optc, opt);
 	}
 
 	/* Handle optional argument not present */
 	if ((flags & UGO_OPTIONALARG)		    /* accept optionals */
-	    && optpos[2] == ':'			    /* opt takes optional */
-	    && (argv[ultraoptind+1] == NULL	    /* optional doesn't exist */
+	    && has_arg == optional_argument	    /* opt takes optional */
+	    && (argv[state->optind+1] == NULL	    /* optional doesn't exist */
 		|| !(flags & UGO_SEPARATEDOPTIONAL) /* separated not accepted */
-		|| like_option(argv[ultraoptind+1], optleaders))) {
-	    ultraoptind++;
-	    return optpos[0];
+		|| like_option(argv[state->optind+1], optleaders))) {
+	    state->optind++;
+	    return found_shortopt(state, opts, optc, opt);
 	}
 
 	/* Handle separated argument missing */
-	if (ultraoptind+2 > argc
+	if (state->optind+2 > argc
 	    || noseparg
-	    || !like_optarg(argv[ultraoptind+1],
+	    || !like_optarg(argv[state->optind+1],
 		    optleaders,
 		    (flags & UGO_HYPHENARG))) {
-	    ultraoptind++;
-	    print_error(flags, errornoargc, argv[0], opt[0]);
+	    state->optind++;
+	    print_error(state->opterr, flags, errornoargc, argv[0], opt[0]);
 
-	    ultraoptopt = opt[0];
+	    state->optopt = opt[0];
 	    if (flags & UGO_MISSINGCOLON)
 		return ':';
 	    else
 		return '?';
 	}
 
-	ultraoptind += 2;
-	ultraoptarg = argv[ultraoptind-1];
-	return optpos[0];
+	state->optind += 2;
+	state->optarg = argv[state->optind-1];
+	return found_shortopt(state, opts, optc, opt);
     }
 
     /* Handle argumentless option with assigned option */
     if ((flags & UGO_SHORTOPTASSIGN)
 	&& opt[1] != '\0' && strchr(assigners, opt[1])) {
-	print_error(flags, errorargc, argv[0], opt[0]);
-	ultraoptnum = 0;
-	ultraoptopt = opt[0];
-	ultraoptind++;
+	print_error(state->opterr, flags, errorargc, argv[0], opt[0]);
+	state->optnum = 0;
+	state->optopt = opt[0];
+	state->optind++;
 	return '?';
     }
 
     if (opt[1] != '\0') {
-	ultraoptnum++;
+	state->optnum++;
     } else {
-	ultraoptnum = 0;
-	ultraoptind++;
+	state->optnum = 0;
+	state->optind++;
     }
     
-    return optpos[0];
+    return found_shortopt(state, opts, optc, opt);
 }
 
-/* POSIX-compliant getopt
- *
- * Handles optional argument '::' specifier as an extension for compatibility
- * with glibc
+/* Leader and name of the option with constraint bit, for error messages
+ * buf - holds the name of a short option
  */
-int ultragetopt(int argc, char * const argv[], const char *optstring)
+static void constraint_name(const struct ultragetopt_constraints *constraints,
+			    int bit, const char **leader, const char **name,
+			    char buf[2])
 {
-    int flags = getoptflags;
+    int c;
 
-#ifdef ULTRAGETOPT_OPTIONPERMUTE
-    flags |= UGO_OPTIONPERMUTE;
-#endif
-
-#ifndef ULTRAGETOPT_NO_OPTIONALARG
-    flags |= UGO_OPTIONALARG;
-#endif
+    if (bit < constraints->nlongopts) {
+	*leader = "--";
+	*name = constraints->longopts[bit].name;
+	return;
+    }
 
-    return ultragetopt_tunable(argc, argv, optstring, NULL, NULL,
-			       unixassigners, unixleaders, flags);
+    for (c=0; c<256; c++)
+	if (constraints->shortbits[c] == bit)
+	    break;
+    buf[0] = (char)c;
+    buf[1] = '\0';
+    *leader = "-";
+    *name = buf;
+}
+
+/* Lowest bit above bit after which is set in mask, and in with and clear in
+ * without (unless they are NULL), or -1 if there is none
+ */
+static int next_bit(const unsigned long *mask, const unsigned long *with,
+		    const unsigned long *without, int nwords, int after)
+{
+    int w;
+
+    for (w = (after + 1) / WORDBITS; w < nwords; w++) {
+	unsigned long bits = mask[w];
+	int bit = 0;
+
+	if (with != NULL)
+	    bits &= with[w];
+	if (without != NULL)
+	    bits &= ~without[w];
+	if (w == (after + 1) / WORDBITS)
+	    bits &= ~0UL << ((after + 1) % WORDBITS);
+	if (bits == 0)
+	    continue;
+
+	while (!(bits & 1UL)) {
+	    bits >>= 1;
+	    bit++;
+	}
+	return w * WORDBITS + bit;
+    }
+
+    return -1;
+}
+
+/* Check the constraints of state once all options are parsed
+ * Returns -1 if they are met, else '?' after printing the violations
+ */
+static int check_constraints(struct ultragetopt_state *state,
+			     char *const argv[], int flags)
+{
+    struct ultragetopt_constraints *constraints = state->constraints;
+    const unsigned long *seen = constraints->seen;
+    int nwords = constraints->nwords;
+    int ret = -1;
+    int i, w;
+
+    constraints->checked = 1;
+
+    for (i=0; i<constraints->nconstraints; i++) {
+	const unsigned long *mask = constraints->masks + i * nwords;
+	const unsigned long *first = constraints->firsts + i * nwords;
+	int kind = constraints->constraints[i].kind;
+	int given = 0;		/* Options given:  0, 1, or 2 (or more) */
+	int triggered = 0;	/* First option given? */
+	int missing = 0;	/* Any option not given? */
+	const char *leader1, *leader2, *name1, *name2;
+	char buf1[2], buf2[2];
+	int bit1, bit2;
+
+	for (w=0; w<nwords; w++) {
+	    unsigned long both = seen[w] & mask[w];
+
+	    if (both != 0)
+		given += (both & (both - 1)) != 0 ? 2 : 1;
+	    triggered |= (seen[w] & first[w]) != 0;
+	    missing |= (mask[w] & ~seen[w]) != 0;
+	}
+
+	if (kind == UGO_REQUIRE && triggered && missing) {
+	    bit1 = next_bit(first, NULL, NULL, nwords, -1);
+	    bit2 = next_bit(mask, NULL, seen, nwords, -1);
+	    constraint_name(constraints, bit1, &leader1, &name1, buf1);
+	    constraint_name(constraints, bit2, &leader2, &name2, buf2);
+	    print_error(state->opterr, flags, errorrequire, argv[0],
+			leader1, name1, leader2, name2);
+	} else if ((kind == UGO_CONFLICT || kind == UGO_ONEOF) && given > 1) {
+	    bit1 = next_bit(mask, seen, NULL, nwords, -1);
+	    bit2 = next_bit(mask, seen, NULL, nwords, bit1);
+	    constraint_name(constraints, bit1, &leader1, &name1, buf1);
+	    constraint_name(constraints, bit2, &leader2, &name2, buf2);
+	    print_error(state->opterr, flags, errorconflict, argv[0],
+			leader1, name1, leader2, name2);
+	} else if ((kind == UGO_ONEOF || kind == UGO_ANYOF) && given == 0) {
+	    print_error(state->opterr, flags, errornone, argv[0],
+			constraints->constraints[i].options);
+	} else
+	    continue;
+
+	ret = '?';
+    }
+
+    if (ret == '?') {
+	state->optopt = 0;
+	state->curind = state->optind;
+    }
+
+    return ret;
+}
+
+/* Option set without any precomputed lookup structures */
+static ALWAYS_INLINE void init_table(struct ultragetopt_table *opts,
+				     const char *shortopts,
+				     const struct option *longopts)
+{
+    opts->shortopts = shortopts;
+    opts->longopts = longopts;
+    opts->nlongopts = 0;
+    opts->namelens = NULL;
+    opts->hashdisp = NULL;
+    opts->hashslots = NULL;
+    opts->shortargs = NULL;
+    opts->shortseps = NULL;
+    opts->longseps = NULL;
+    opts->trie = NULL;
+    opts->trielabels = NULL;
+    opts->packed = NULL;
+}
+
+/* Parse the next option, then check constraints once all options are
+ * parsed and trace the result
+ * Leading flag characters must already be removed from opts->shortopts
+ */
+static ALWAYS_INLINE int getopt_next(struct ultragetopt_state *state,
+				     int argc, char *const argv[],
+				     const struct ultragetopt_table *opts,
+				     int *indexptr, const char *assigners,
+				     const char *optleaders, int flags)
+{
+    int ret;
+
+    ret = getopt_table(state, argc, argv, opts, indexptr, assigners,
+		       optleaders, flags);
+    if (ret == -1 && state->constraints != NULL
+	&& !state->constraints->checked)
+	ret = check_constraints(state, argv, flags);
+    if (state->trace != NULL)
+	trace_result(state, argv, ret);
+
+    return ret;
+}
+
+/* Instance of the parser for the given arguments
+ * Called with constant flags (and assigners and optleaders) so that tests of
+ * those fold away in each copy of the parser:  one per public function or
+ * group of functions with the same flags (see getopt_long_instance()),
+ * except ultragetopt_tunable_r() which is the instance for runtime flags
+ */
+static ALWAYS_INLINE int getopt_instance(struct ultragetopt_state *state,
+					 int argc, char *const argv[],
+					 const struct ultragetopt_table *table,
+					 int *indexptr, const char *assigners,
+					 const char *optleaders, int flags)
+{
+    struct ultragetopt_table opts = *table;
+
+    flags = shortopts_flags(&opts.shortopts, flags);
+
+    return getopt_next(state, argc, argv, &opts, indexptr, assigners,
+		       optleaders, flags);
+}
+
+/* Flags of ultragetopt_long() and its table, reentrant, and dispatch
+ * variants (before shortopts_flags())
+ */
+#define LONGFLAGS (getoptflags | UGO_OPTIONPERMUTE | UGO_OPTIONALARG)
+
+/* Instance of the parser core for LONGFLAGS, shared by all of the
+ * ultragetopt_long() variants
+ * flags - LONGFLAGS as updated by shortopts_flags() for opts->shortopts
+ */
+static NEVER_INLINE int getopt_long_next(struct ultragetopt_state *state,
+					 int argc, char *const argv[],
+					 const struct ultragetopt_table *opts,
+					 int *indexptr, int flags)
+{
+    /* Only the flags from shortopts vary, so tests of the others fold */
+    flags = (flags & SHORTOPTS_FLAGS) | (LONGFLAGS & ~SHORTOPTS_FLAGS);
+
+    return getopt_next(state, argc, argv, opts, indexptr, unixassigners,
+		       unixleaders, flags);
+}
+
+/* Parse the next option as ultragetopt_long() */
+static int getopt_long_instance(struct ultragetopt_state *state, int argc,
+				char *const argv[],
+				const struct ultragetopt_table *table,
+				int *indexptr)
+{
+    struct ultragetopt_table opts = *table;
+    int flags;
+
+    flags = shortopts_flags(&opts.shortopts, LONGFLAGS);
+
+    return getopt_long_next(state, argc, argv, &opts, indexptr, flags);
+}
+
+/* Load the parser state from the ultraopt* variables */
+static ALWAYS_INLINE void load_globals(struct ultragetopt_state *state)
+{
+    state->optarg = ultraoptarg;
+    state->optind = ultraoptind;
+    state->opterr = ultraopterr;
+    state->optopt = ultraoptopt;
+    state->optreset = ultraoptreset;
+    state->optnum = ultraoptnum;
+    state->occurrences = ultraoptoccur;
+    state->trace = ultraopttrace;
+    state->classes = ultraoptclasses;
+    state->constraints = ultraoptconstraints;
+    state->values = ultraoptvalues;
+}
+
+/* Store the parser state in the ultraopt* variables */
+static ALWAYS_INLINE void store_globals(const struct ultragetopt_state *state)
+{
+    ultraoptarg = state->optarg;
+    ultraoptind = state->optind;
+    ultraopterr = state->opterr;
+    ultraoptopt = state->optopt;
+    ultraoptreset = state->optreset;
+    ultraoptnum = state->optnum;
+    ultraoptseps = state->optseps;
+}
+
+/* Instance of the parser using the ultraopt* variables as its state */
+static ALWAYS_INLINE int getopt_global(int argc, char *const argv[],
+				       const struct ultragetopt_table *table,
+				       int *indexptr, const char *assigners,
+				       const char *optleaders, int flags)
+{
+    struct ultragetopt_state state;
+    int ret;
+
+    load_globals(&state);
+    ret = getopt_instance(&state, argc, argv, table, indexptr, assigners,
+			  optleaders, flags);
+    store_globals(&state);
+
+    return ret;
+}
+
+int ultragetopt_tunable(int argc, char *const argv[], const char *shortopts,
+			const struct option *longopts, int *indexptr,
+			const char *assigners, const char *optleaders,
+			int flags)
+{
+    struct ultragetopt_table opts;
+
+    init_table(&opts, shortopts, longopts);
+
+    return ultragetopt_tunable_table(argc, argv, &opts, indexptr, assigners,
+				     optleaders, flags);
+}
+
+int ultragetopt_tunable_table(int argc, char *const argv[],
+			      const struct ultragetopt_table *table,
+			      int *indexptr, const char *assigners,
+			      const char *optleaders, int flags)
+{
+    struct ultragetopt_state state;
+    int ret;
+
+    load_globals(&state);
+    ret = ultragetopt_tunable_r(&state, argc, argv, table, indexptr,
+				assigners, optleaders, flags);
+    store_globals(&state);
+
+    return ret;
+}
+
+void ultragetopt_state_init(struct ultragetopt_state *state)
+{
+    state->optarg = NULL;
+    state->optind = 1;
+    state->opterr = 1;
+#ifdef ULTRAGETOPT_DEFAULTOPTOPT
+    state->optopt = ULTRAGETOPT_DEFAULTOPTOPT -0;
+#else
+    state->optopt = 0;
+#endif
+    state->optreset = 0;
+    state->optnum = 0;
+    state->longind = -1;
+    state->curind = -1;
+    state->optname = NULL;
+    state->occurrences = NULL;
+    state->trace = NULL;
+    state->classes = NULL;
+    state->constraints = NULL;
+    state->values = NULL;
+    state->optseps = NULL;
+}
+
+int ultragetopt_tunable_r(struct ultragetopt_state *state, int argc,
+			  char *const argv[],
+			  const struct ultragetopt_table *table,
+			  int *indexptr, const char *assigners,
+			  const char *optleaders, int flags)
+{
+    return getopt_instance(state, argc, argv, table, indexptr, assigners,
+			   optleaders, flags);
+}
+
+int ultragetopt_long_r(struct ultragetopt_state *state, int argc,
+		       char *const argv[], const char *shortopts,
+		       const struct option *longopts, int *indexptr)
+{
+    struct ultragetopt_table opts;
+
+    init_table(&opts, shortopts, longopts);
+
+    return getopt_long_instance(state, argc, argv, &opts, indexptr);
+}
+
+int ultragetopt_long_table_r(struct ultragetopt_state *state, int argc,
+			     char *const argv[],
+			     const struct ultragetopt_table *table,
+			     int *indexptr)
+{
+    return getopt_long_instance(state, argc, argv, table, indexptr);
+}
+
+/* POSIX-compliant getopt
+ *
+ * Handles optional argument '::' specifier as an extension for compatibility
+ * with glibc
+ */
+int ultragetopt(int argc, char * const argv[], const char *optstring)
+{
+    struct ultragetopt_table opts;
+    int flags = getoptflags;
+
+#ifdef ULTRAGETOPT_OPTIONPERMUTE
+    flags |= UGO_OPTIONPERMUTE;
+#endif
+
+#ifndef ULTRAGETOPT_NO_OPTIONALARG
+    flags |= UGO_OPTIONALARG;
+#endif
+
+    init_table(&opts, optstring, NULL);
+
+    return getopt_global(argc, argv, &opts, NULL,
+			   unixassigners, unixleaders, flags);
 }
 
 /* GNU getopt_long workalike
@@ -791,36 +1729,1764 @@ int ultragetopt(int argc, char * const argv[], const char *optstring)
 int ultragetopt_long(int argc, char *const argv[], const char *shortopts,
 		const struct option *longopts, int *indexptr)
 {
-    return ultragetopt_tunable(argc, argv, shortopts, longopts, indexptr,
-			       unixassigners, unixleaders,
-			       getoptflags | UGO_OPTIONPERMUTE | UGO_OPTIONALARG);
+    struct ultragetopt_table opts;
+
+    init_table(&opts, shortopts, longopts);
+
+    return ultragetopt_long_table(argc, argv, &opts, indexptr);
 }
 
 /* GNU getopt_long_only workalike */
 int ultragetopt_long_only(int argc, char *const argv[], const char *shortopts,
 			  const struct option *longopts, int *indexptr)
 {
-    return ultragetopt_tunable(argc, argv, shortopts, longopts, indexptr,
-			       unixassigners, unixleaders,
-			       getoptflags | UGO_SINGLELEADERLONG
-			       | UGO_OPTIONPERMUTE | UGO_OPTIONALARG);
+    struct ultragetopt_table opts;
+
+    init_table(&opts, shortopts, longopts);
+
+    return getopt_global(argc, argv, &opts, indexptr,
+			   unixassigners, unixleaders,
+			   getoptflags | UGO_SINGLELEADERLONG
+			   | UGO_OPTIONPERMUTE | UGO_OPTIONALARG);
+}
+
+/* GNU getopt_long workalike using a precomputed option table */
+int ultragetopt_long_table(int argc, char *const argv[],
+			   const struct ultragetopt_table *table, int *indexptr)
+{
+    struct ultragetopt_state state;
+    int ret;
+
+    load_globals(&state);
+    ret = getopt_long_instance(&state, argc, argv, table, indexptr);
+    store_globals(&state);
+
+    return ret;
 }
 
 int ultragetopt_dos(int argc, char * const argv[], const char *optstring)
 {
-    return ultragetopt_tunable(argc, argv, optstring, NULL, NULL,
-			       dosassigners, dosleaders,
-			       getoptflags | UGO_CASEINSENSITIVE);
+    struct ultragetopt_table opts;
+
+    init_table(&opts, optstring, NULL);
+
+    return getopt_global(argc, argv, &opts, NULL,
+			   dosassigners, dosleaders,
+			   getoptflags | UGO_CASEINSENSITIVE);
 }
 
 int ultragetopt_long_dos(int argc, char *const argv[], const char *shortopts,
 			 const struct option *longopts, int *indexptr)
 {
-    return ultragetopt_tunable(argc, argv, shortopts, longopts, indexptr,
-			       dosassigners, dosleaders,
-			       getoptflags | UGO_CASEINSENSITIVE
-			       | UGO_SINGLELEADERLONG | UGO_SINGLELEADERONLY
-			       | UGO_OPTIONPERMUTE | UGO_OPTIONALARG);
+    struct ultragetopt_table opts;
+
+    init_table(&opts, shortopts, longopts);
+
+    return getopt_global(argc, argv, &opts, indexptr,
+			   dosassigners, dosleaders,
+			   getoptflags | UGO_CASEINSENSITIVE
+			   | UGO_SINGLELEADERLONG | UGO_SINGLELEADERONLY
+			   | UGO_OPTIONPERMUTE | UGO_OPTIONALARG);
+}
+
+/* Call the handler for what the getopt functions returned (c)
+ * Returns 0 to continue, or the value for the dispatch function to return
+ */
+static int dispatch_option(const struct ultragetopt_handlers *handlers,
+			   void *context, int c, int longind, char *arg,
+			   int flags)
+{
+    ultragetopt_handler handler = NULL;
+
+    if (longind >= 0) {
+	if (handlers->longhandlers != NULL)
+	    handler = handlers->longhandlers[longind];
+	if (handler == NULL && c != 0 && handlers->shorthandlers != NULL)
+	    handler = handlers->shorthandlers[(unsigned char)c];
+    } else if (c == '?' || c == ':') {
+	if (handlers->error == NULL)
+	    return c;
+	handler = handlers->error;
+    } else if (c == 1 && (flags & UGO_NONOPTARG)) {
+	handler = handlers->operand;
+    } else if (handlers->shorthandlers != NULL) {
+	handler = handlers->shorthandlers[(unsigned char)c];
+    }
+
+    if (handler != NULL)
+	return handler(context, c, longind, arg);
+
+    return 0;
+}
+
+int ultragetopt_dispatch(int argc, char *const argv[], const char *shortopts,
+			 const struct option *longopts,
+			 const struct ultragetopt_handlers *handlers,
+			 void *context)
+{
+    struct ultragetopt_table opts;
+
+    init_table(&opts, shortopts, longopts);
+
+    return ultragetopt_dispatch_table(argc, argv, &opts, handlers, context);
+}
+
+int ultragetopt_dispatch_table(int argc, char *const argv[],
+			       const struct ultragetopt_table *table,
+			       const struct ultragetopt_handlers *handlers,
+			       void *context)
+{
+    struct ultragetopt_state state;
+    struct ultragetopt_table opts = *table;
+    int flags;
+
+    flags = shortopts_flags(&opts.shortopts, LONGFLAGS);
+
+    load_globals(&state);
+
+    for (;;) {
+	int longind = -1;
+	int c, ret;
+
+	c = getopt_long_next(&state, argc, argv, &opts, &longind, flags);
+
+	/* Keep the ultraopt* variables current for the handlers */
+	store_globals(&state);
+
+	if (c == -1)
+	    return 0;
+
+	ret = dispatch_option(handlers, context, c, longind, state.optarg,
+			      flags);
+	if (ret != 0)
+	    return ret;
+    }
+}
+
+/* FNV-1a hash of the case-folded characters of name
+ * Matches the hash used by ultragetopt-gen for struct ultragetopt_table
+ * The result is mixed so that its low bits depend on all of the characters
+ * (FNV-1a alone keeps the parity of the characters in bit 0, so two names
+ * can land in the same slot of an even-sized table for every seed)
+ */
+unsigned long ultragetopt_hash(const char *name, size_t len,
+			       unsigned long seed)
+{
+    unsigned long hash = seed != 0 ? seed : 0x811c9dc5UL;
+    size_t i;
+
+    for (i=0; i<len; i++) {
+	hash ^= (unsigned long)tolower((unsigned char)name[i]);
+	hash = (hash * 0x01000193UL) & 0xffffffffUL;
+    }
+
+    hash ^= hash >> 16;
+    hash = (hash * 0x45d9f3bUL) & 0xffffffffUL;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+void ultragetopt_occurrences_init(struct ultragetopt_occurrences *occ,
+				  struct ultragetopt_occurrence *longocc,
+				  int nlongopts)
+{
+    int i;
+
+    for (i=0; i < (int)(sizeof(occ->shortopts) / sizeof(occ->shortopts[0]));
+	 i++) {
+	occ->shortopts[i].count = 0;
+	occ->shortopts[i].first = -1;
+	occ->shortopts[i].last = -1;
+	occ->shortopts[i].arg = NULL;
+    }
+
+    occ->longopts = longocc;
+    occ->nlongopts = longocc != NULL ? nlongopts : 0;
+    for (i=0; i < occ->nlongopts; i++) {
+	longocc[i].count = 0;
+	longocc[i].first = -1;
+	longocc[i].last = -1;
+	longocc[i].arg = NULL;
+    }
+}
+
+/* Each element is found with strcspn(), which C libraries implement with
+ * word-at-a-time or vector scans, so a list is split in a single pass
+ */
+int ultragetopt_split(const char **pos, const char *separators,
+		      struct ultragetopt_span *span)
+{
+    const char *cur = *pos;
+    size_t len;
+
+    if (cur == NULL)
+	return 0;
+
+    if (separators != NULL)
+	len = strcspn(cur, separators);
+    else
+	len = strlen(cur);
+
+    span->ptr = cur;
+    span->len = len;
+    *pos = cur[len] != '\0' ? cur+len+1 : NULL;
+
+    return 1;
+}
+
+void ultragetopt_trace_init(struct ultragetopt_trace *trace,
+			    struct ultragetopt_event *events, size_t nevents)
+{
+    unsigned long size = 1;
+
+    while (size * 2 <= nevents)
+	size *= 2;
+
+    /* Without room for an event nothing is recorded, rather than every
+     * event going to events[0] */
+    trace->events = nevents > 0 ? events : NULL;
+    trace->mask = size - 1;
+    trace->next = 0;
+}
+
+/* Write c as a JSON string */
+static void json_char(FILE *out, int c)
+{
+    if (c == '"' || c == '\\')
+	fprintf(out, "\"\\%c\"", c);
+    else if (c >= 0x20 && c < 0x7f)
+	fprintf(out, "\"%c\"", c);
+    else
+	fprintf(out, "\"\\u%04x\"", (unsigned)c & 0xffffU);
+}
+
+int ultragetopt_trace_dump(const struct ultragetopt_trace *trace, FILE *out)
+{
+    static const char *const kinds[] = {
+	"unknown", "classify", "long", "short", "argument", "permute",
+	"error", "end"
+    };
+    static const char *const classes[] = {
+	"unknown", "option", "terminator", "operand"
+    };
+    unsigned long next = trace->next;
+    unsigned long first, seq;
+
+    /* Only the last mask+1 events are still in the buffer */
+    first = next > trace->mask ? next - trace->mask - 1 : 0;
+
+    putc('[', out);
+    for (seq = first; seq < next; seq++) {
+	const struct ultragetopt_event *event =
+	    &trace->events[seq & trace->mask];
+	int kind = event->kind < sizeof(kinds) / sizeof(kinds[0])
+		   ? event->kind : 0;
+
+	fprintf(out, "%s\n  {\"seq\": %lu, \"event\": \"%s\", \"index\": %d",
+		seq != first ? "," : "", seq, kinds[kind], event->index);
+
+	switch (kind) {
+	    case UGO_TRACE_CLASSIFY:
+		fprintf(out, ", \"class\": \"%s\"",
+			event->value > 0 && event->value
+			< (int)(sizeof(classes) / sizeof(classes[0]))
+			? classes[event->value] : classes[0]);
+		break;
+	    case UGO_TRACE_LONG:
+		fprintf(out, ", \"longind\": %d", event->value);
+		break;
+	    case UGO_TRACE_SHORT:
+		fputs(", \"option\": ", out);
+		json_char(out, event->value);
+		break;
+	    case UGO_TRACE_ARGUMENT:
+		fprintf(out, ", \"offset\": %d", event->value);
+		break;
+	    case UGO_TRACE_PERMUTE:
+		fprintf(out, ", \"to\": %d", event->value);
+		break;
+	    case UGO_TRACE_ERROR:
+		fputs(", \"return\": ", out);
+		json_char(out, event->value);
+		break;
+	}
+	putc('}', out);
+    }
+    fputs(next > 0 ? "\n]\n" : "]\n", out);
+
+    return ferror(out) ? -1 : 0;
+}
+
+/* Smallest part of argv worth classifying in a thread of its own
+ * (tests/classify defines it lower to split small argvs)
+ */
+#ifndef CLASSIFY_MINCHUNK
+# define CLASSIFY_MINCHUNK 65536
+#endif
+
+/* Part of argv classified by one thread */
+struct classify_chunk {
+    char *const *argv;
+    const char *optleaders;
+    int begin;			/* First argv index of the part */
+    int end;			/* argv index after the part */
+    int *options;		/* Indexes of the options found */
+    int noptions;		/* Entries in options */
+    int failed;			/* Could memory not be allocated? */
+};
+
+/* Find the elements of a part of argv which look like options */
+static void classify_chunk(struct classify_chunk *chunk)
+{
+    int size = 0;
+    int i;
+
+    chunk->options = NULL;
+    chunk->noptions = 0;
+    chunk->failed = 0;
+
+    for (i = chunk->begin; i < chunk->end; i++) {
+	const char *arg = chunk->argv[i];
+
+	if (!like_option(arg, chunk->optleaders)
+	    && !like_optterm(arg, chunk->optleaders))
+	    continue;
+
+	if (chunk->noptions == size) {
+	    int *options;
+
+	    size = size ? size * 2 : 64;
+	    options = realloc(chunk->options, sizeof(int) * size);
+	    if (options == NULL) {
+		chunk->failed = 1;
+		return;
+	    }
+	    chunk->options = options;
+	}
+
+	chunk->options[chunk->noptions++] = i;
+    }
+}
+
+#if HAVE_PTHREAD
+static void *classify_thread(void *chunk)
+{
+    classify_chunk(chunk);
+    return NULL;
+}
+#endif
+
+struct ultragetopt_classes *ultragetopt_classify(int argc, char *const argv[],
+						 const char *optleaders,
+						 int nthreads)
+{
+    struct ultragetopt_classes *classes = NULL;
+    struct classify_chunk *chunks;
+#if HAVE_PTHREAD
+    pthread_t *threads;
+    int *started;
+#endif
+    int nchunks, noptions = 0, failed = 0;
+    int begin = argc > 1 ? 1 : argc;	/* argv[0] is never an option */
+    int i;
+
+    if (nthreads <= 0) {
+#if HAVE_SYSCONF && defined(_SC_NPROCESSORS_ONLN)
+	nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (nthreads <= 0)
+	    nthreads = 1;
+    }
+#if !HAVE_PTHREAD
+    nthreads = 1;
+#endif
+
+    nchunks = (argc - begin) / CLASSIFY_MINCHUNK;
+    if (nchunks > nthreads)
+	nchunks = nthreads;
+    if (nchunks < 1)
+	nchunks = 1;
+
+    chunks = malloc(sizeof(*chunks) * nchunks);
+    if (chunks == NULL)
+	return NULL;
+
+    /* The last part takes the remainder */
+    for (i=0; i<nchunks; i++) {
+	chunks[i].argv = argv;
+	chunks[i].optleaders = optleaders;
+	chunks[i].begin = begin + (argc - begin) / nchunks * i;
+	chunks[i].end = i+1 < nchunks
+	    ? chunks[i].begin + (argc - begin) / nchunks : argc;
+    }
+
+#if HAVE_PTHREAD
+    /* Classify the first part in this thread and the rest in new threads
+     * (or this one, if a thread can not be created) */
+    threads = malloc(sizeof(*threads) * nchunks);
+    started = calloc(nchunks, sizeof(*started));
+    if (threads != NULL && started != NULL)
+	for (i=1; i<nchunks; i++)
+	    started[i] = pthread_create(&threads[i], NULL, classify_thread,
+					&chunks[i]) == 0;
+
+    for (i=0; i<nchunks; i++) {
+	if (started != NULL && started[i])
+	    pthread_join(threads[i], NULL);
+	else
+	    classify_chunk(&chunks[i]);
+    }
+
+    free(threads);
+    free(started);
+#else
+    classify_chunk(&chunks[0]);
+#endif
+
+    /* Join the parts, which are in argv order */
+    for (i=0; i<nchunks; i++) {
+	noptions += chunks[i].noptions;
+	failed |= chunks[i].failed;
+    }
+
+    if (!failed)
+	classes = malloc(sizeof(*classes) + sizeof(int) * noptions);
+    if (classes != NULL) {
+	classes->argc = argc;
+	classes->options = (int *)(classes + 1);
+	classes->noptions = 0;
+	classes->next = 0;
+	for (i=0; i<nchunks; i++) {
+	    if (chunks[i].noptions > 0)
+		memcpy(classes->options + classes->noptions,
+		       chunks[i].options, sizeof(int) * chunks[i].noptions);
+	    classes->noptions += chunks[i].noptions;
+	}
+    }
+
+    for (i=0; i<nchunks; i++)
+	free(chunks[i].options);
+    free(chunks);
+
+    return classes;
+}
+
+void ultragetopt_classes_free(struct ultragetopt_classes *classes)
+{
+    free(classes);
+}
+
+/* Number the options for bitsets and per-option arrays:  long options are
+ * 0 to nlongopts-1, each short option which is the val of a long option
+ * without a flag shares its number, and the other short options follow
+ * shortbits - set to the number of each short option character, or -1
+ * Returns the number of numbers used
+ */
+static int number_options(const char *shortopts,
+			  const struct option *longopts, int nlongopts,
+			  int shortbits[256])
+{
+    int nbits = nlongopts;
+    int i, c;
+
+    for (c=0; c<256; c++)
+	shortbits[c] = -1;
+    if (shortopts == NULL)
+	return nbits;
+
+    while (*shortopts == '+' || *shortopts == '-' || *shortopts == ':')
+	shortopts++;
+    for ( ; *shortopts; shortopts++) {
+	c = (unsigned char)*shortopts;
+	if (c == ':' || shortbits[c] >= 0)
+	    continue;
+
+	for (i=0; i<nlongopts; i++)
+	    if (longopts[i].flag == NULL && longopts[i].val == c)
+		break;
+	shortbits[c] = i < nlongopts ? i : nbits++;
+    }
+
+    return nbits;
+}
+
+/* Number (see number_options()) of the option named by the len characters
+ * at name (a long option name or short option character), or -1
+ */
+static int option_number(const struct option *longopts, int nlongopts,
+			 const int shortbits[256], const char *name,
+			 size_t len)
+{
+    int i;
+
+    for (i=0; i<nlongopts; i++)
+	if (strncmp(longopts[i].name, name, len) == 0
+	    && longopts[i].name[len] == '\0')
+	    return i;
+
+    if (len == 1)
+	return shortbits[(unsigned char)name[0]];
+
+    return -1;
+}
+
+struct ultragetopt_constraints *ultragetopt_constraints_create(
+	const struct ultragetopt_constraint *constraints,
+	const char *shortopts, const struct option *longopts)
+{
+    struct ultragetopt_constraints *compiled;
+    unsigned long *bitsets;
+    int nconstraints = 0, nlongopts = 0, nbits;
+    int i;
+
+    while (constraints[nconstraints].kind != 0)
+	nconstraints++;
+    if (longopts != NULL)
+	while (longopts[nlongopts].name != NULL)
+	    nlongopts++;
+
+    compiled = malloc(sizeof(*compiled));
+    if (compiled == NULL)
+	return NULL;
+
+    compiled->constraints = constraints;
+    compiled->nconstraints = nconstraints;
+    compiled->longopts = longopts;
+    compiled->nlongopts = nlongopts;
+    compiled->checked = 0;
+
+    nbits = number_options(shortopts, longopts, nlongopts,
+			   compiled->shortbits);
+
+    compiled->nwords = nbits > 0 ? (nbits + WORDBITS - 1) / WORDBITS : 1;
+    bitsets = calloc((size_t)(2 * nconstraints + 1) * compiled->nwords,
+		     sizeof(unsigned long));
+    if (bitsets == NULL) {
+	free(compiled);
+	return NULL;
+    }
+    compiled->masks = bitsets;
+    compiled->firsts = bitsets + nconstraints * compiled->nwords;
+    compiled->seen = compiled->firsts + nconstraints * compiled->nwords;
+
+    for (i=0; i<nconstraints; i++) {
+	const char *name = constraints[i].options;
+	int nnames = 0;
+
+	while (*name != '\0') {
+	    size_t len = strcspn(name, " ");
+	    int bit;
+
+	    if (len == 0) {
+		name++;
+		continue;
+	    }
+
+	    bit = option_number(longopts, nlongopts, compiled->shortbits,
+				name, len);
+	    if (bit < 0) {
+		fprintf(stderr, "ultragetopt: unknown option `%.*s' in "
+			"constraint \"%s\"\n", (int)len, name,
+			constraints[i].options);
+		ultragetopt_constraints_free(compiled);
+		return NULL;
+	    }
+
+	    compiled->masks[i * compiled->nwords + bit / WORDBITS]
+		|= 1UL << (bit % WORDBITS);
+	    if (nnames++ == 0)
+		compiled->firsts[i * compiled->nwords + bit / WORDBITS]
+		    |= 1UL << (bit % WORDBITS);
+	    name += len;
+	}
+    }
+
+    return compiled;
+}
+
+void ultragetopt_constraints_reset(struct ultragetopt_constraints *constraints)
+{
+    int w;
+
+    for (w=0; w<constraints->nwords; w++)
+	constraints->seen[w] = 0;
+    constraints->checked = 0;
+}
+
+void ultragetopt_constraints_free(struct ultragetopt_constraints *constraints)
+{
+    free(constraints->masks);
+    free(constraints);
+}
+
+struct ultragetopt_values *ultragetopt_values_create(const char *accumulate,
+	const char *shortopts, const struct option *longopts, void *arena,
+	size_t arenasize)
+{
+    struct ultragetopt_values *values;
+    int shortbits[256];
+    int *numlists;
+    int nlongopts = 0, nbits, nlists = 0;
+    const char *name;
+    int i, c;
+
+    if (longopts != NULL)
+	while (longopts[nlongopts].name != NULL)
+	    nlongopts++;
+
+    nbits = number_options(shortopts, longopts, nlongopts, shortbits);
+    numlists = malloc((size_t)(nbits > 0 ? nbits : 1) * sizeof(int));
+    if (numlists == NULL)
+	return NULL;
+    for (i=0; i<nbits; i++)
+	numlists[i] = -1;
+
+    /* Give each named option (and so its short/long alias) a list */
+    for (name=accumulate; *name != '\0'; ) {
+	size_t len = strcspn(name, " ");
+	int num;
+
+	if (len == 0) {
+	    name++;
+	    continue;
+	}
+
+	num = option_number(longopts, nlongopts, shortbits, name, len);
+	if (num < 0) {
+	    fprintf(stderr, "ultragetopt: unknown option `%.*s' to "
+		    "accumulate\n", (int)len, name);
+	    free(numlists);
+	    return NULL;
+	}
+	if (numlists[num] < 0)
+	    numlists[num] = nlists++;
+	name += len;
+    }
+
+    /* One allocation, ordered by alignment */
+    values = malloc(sizeof(*values)
+		    + (size_t)nlists * sizeof(struct ultragetopt_valuelist)
+		    + (size_t)nlongopts * sizeof(int));
+    if (values == NULL) {
+	free(numlists);
+	return NULL;
+    }
+    values->lists = (struct ultragetopt_valuelist *)(values + 1);
+    values->longlists = (int *)(values->lists + nlists);
+
+    values->longopts = longopts;
+    values->nlongopts = nlongopts;
+    values->nlists = nlists;
+    for (c=0; c<256; c++)
+	values->shortlists[c] = shortbits[c] >= 0 ? numlists[shortbits[c]] : -1;
+    for (i=0; i<nlongopts; i++)
+	values->longlists[i] = numlists[i];
+    free(numlists);
+
+    values->blocks = NULL;
+    values->buffer = arena;
+    values->buffersize = arena != NULL ? arenasize : 0;
+    ultragetopt_values_reset(values);
+
+    return values;
+}
+
+char **ultragetopt_values_get(const struct ultragetopt_values *values,
+			      const char *name, int *count)
+{
+    int list = -1;
+    int i;
+
+    for (i=0; i<values->nlongopts; i++)
+	if (strcmp(values->longopts[i].name, name) == 0) {
+	    list = values->longlists[i];
+	    break;
+	}
+    if (i == values->nlongopts && name[0] != '\0' && name[1] == '\0')
+	list = values->shortlists[(unsigned char)name[0]];
+
+    if (list < 0 || values->lists[list].count == 0) {
+	*count = 0;
+	return NULL;
+    }
+
+    *count = values->lists[list].count;
+    return values->lists[list].values;
+}
+
+void ultragetopt_values_reset(struct ultragetopt_values *values)
+{
+    struct arena_block *block, *next;
+    int i;
+
+    for (block=values->blocks; block != NULL; block=next) {
+	next = block->next;
+	free(block);
+    }
+    values->blocks = NULL;
+
+    values->arena = values->buffer;
+    values->arenasize = values->buffersize;
+    values->arenaused = 0;
+    values->failed = 0;
+
+    for (i=0; i<values->nlists; i++) {
+	values->lists[i].values = NULL;
+	values->lists[i].count = 0;
+	values->lists[i].size = 0;
+    }
+}
+
+void ultragetopt_values_free(struct ultragetopt_values *values)
+{
+    values->buffer = NULL;
+    ultragetopt_values_reset(values);
+    free(values);
+}
+
+struct ultragetopt_packed *ultragetopt_packed_create(void)
+{
+    struct ultragetopt_packed *packed;
+
+    packed = malloc(sizeof(*packed));
+    if (packed == NULL)
+	return NULL;
+
+    packed->slots = calloc(16, sizeof(*packed->slots));
+    if (packed->slots == NULL) {
+	free(packed);
+	return NULL;
+    }
+    packed->slotmask = 15;
+
+    packed->pool = NULL;
+    packed->poolused = 0;
+    packed->poolsize = 0;
+    packed->offsets = NULL;
+    packed->lengths = NULL;
+    packed->hasargs = NULL;
+    packed->vals = NULL;
+    packed->flags = NULL;
+    packed->count = 0;
+    packed->size = 0;
+
+    return packed;
+}
+
+/* Double the room for options in the arrays of packed
+ * Returns 1 on success, 0 if memory could not be allocated (arrays already
+ * grown are kept, which is harmless)
+ */
+static int packed_grow(struct ultragetopt_packed *packed)
+{
+    int size = packed->size > 0 ? 2 * packed->size : 64;
+    unsigned int *offsets, *lengths;
+    unsigned char *hasargs;
+    int *vals;
+
+    offsets = realloc(packed->offsets, (size_t)size * sizeof(*offsets));
+    if (offsets == NULL)
+	return 0;
+    packed->offsets = offsets;
+
+    lengths = realloc(packed->lengths, (size_t)size * sizeof(*lengths));
+    if (lengths == NULL)
+	return 0;
+    packed->lengths = lengths;
+
+    hasargs = realloc(packed->hasargs, (size_t)size * sizeof(*hasargs));
+    if (hasargs == NULL)
+	return 0;
+    packed->hasargs = hasargs;
+
+    vals = realloc(packed->vals, (size_t)size * sizeof(*vals));
+    if (vals == NULL)
+	return 0;
+    packed->vals = vals;
+
+    if (packed->flags != NULL) {
+	int **flags = realloc(packed->flags, (size_t)size * sizeof(*flags));
+	int i;
+
+	if (flags == NULL)
+	    return 0;
+	for (i=packed->size; i<size; i++)
+	    flags[i] = NULL;
+	packed->flags = flags;
+    }
+
+    packed->size = size;
+    return 1;
+}
+
+/* Double the slots of the hash of packed
+ * Returns 1 on success, 0 if memory could not be allocated
+ */
+static int packed_rehash(struct ultragetopt_packed *packed)
+{
+    unsigned long slotmask = 2 * packed->slotmask + 1;
+    struct ultragetopt_packedslot *slots;
+    unsigned long i, j;
+
+    slots = calloc(slotmask + 1, sizeof(*slots));
+    if (slots == NULL)
+	return 0;
+
+    /* Slots hold the full hash, so names need not be hashed again */
+    for (i=0; i<=packed->slotmask; i++) {
+	if (packed->slots[i].longind == 0)
+	    continue;
+
+	for (j = packed->slots[i].hash & slotmask; slots[j].longind != 0;
+	     j = (j + 1) & slotmask)
+	    ;
+	slots[j] = packed->slots[i];
+    }
+
+    free(packed->slots);
+    packed->slots = slots;
+    packed->slotmask = slotmask;
+    return 1;
+}
+
+int ultragetopt_packed_add(struct ultragetopt_packed *packed,
+			   const char *name, int has_arg, int *flag, int val)
+{
+    size_t len = strlen(name);
+    unsigned int hash = (unsigned int)ultragetopt_hash(name, len, 0);
+    unsigned long i;
+    int longind;
+
+    if (len >= UINT_MAX - packed->poolused || packed->count == INT_MAX / 2)
+	return -1;
+
+    for (i = hash & packed->slotmask; packed->slots[i].longind != 0;
+	 i = (i + 1) & packed->slotmask) {
+	longind = (int)packed->slots[i].longind - 1;
+	if (packed->slots[i].hash == hash
+	    && packed->lengths[longind] == len
+	    && memcmp(name, packed->pool + packed->offsets[longind], len)
+	       == 0)
+	    return -1;
+    }
+
+    if (packed->count == packed->size && !packed_grow(packed))
+	return -1;
+
+    if (flag != NULL && packed->flags == NULL) {
+	packed->flags = calloc((size_t)packed->size, sizeof(*packed->flags));
+	if (packed->flags == NULL)
+	    return -1;
+    }
+
+    if (len + 1 > packed->poolsize - packed->poolused) {
+	unsigned int poolsize = packed->poolsize > 0 ? packed->poolsize : 1024;
+	char *pool;
+
+	while (len + 1 > poolsize - packed->poolused)
+	    poolsize = poolsize <= UINT_MAX / 2 ? 2 * poolsize : UINT_MAX;
+	pool = realloc(packed->pool, poolsize);
+	if (pool == NULL)
+	    return -1;
+	packed->pool = pool;
+	packed->poolsize = poolsize;
+    }
+
+    /* Keep the hash at most half full */
+    if (2 * ((unsigned long)packed->count + 1) > packed->slotmask + 1) {
+	if (!packed_rehash(packed))
+	    return -1;
+	for (i = hash & packed->slotmask; packed->slots[i].longind != 0;
+	     i = (i + 1) & packed->slotmask)
+	    ;
+    }
+
+    longind = packed->count++;
+    memcpy(packed->pool + packed->poolused, name, len + 1);
+    packed->offsets[longind] = packed->poolused;
+    packed->lengths[longind] = (unsigned int)len;
+    packed->poolused += (unsigned int)len + 1;
+    packed->hasargs[longind] = (unsigned char)has_arg;
+    packed->vals[longind] = val;
+    if (packed->flags != NULL)
+	packed->flags[longind] = flag;
+    packed->slots[i].hash = hash;
+    packed->slots[i].longind = (unsigned int)longind + 1;
+
+    return longind;
+}
+
+int ultragetopt_packed_find(const struct ultragetopt_packed *packed,
+			    const char *name)
+{
+    return packed_longopt(packed, name, strlen(name), 0);
+}
+
+void ultragetopt_packed_table(const struct ultragetopt_packed *packed,
+			      const char *shortopts,
+			      struct ultragetopt_table *table)
+{
+    init_table(table, shortopts, NULL);
+    table->nlongopts = packed->count;
+    table->packed = packed;
+}
+
+void ultragetopt_packed_free(struct ultragetopt_packed *packed)
+{
+    free(packed->pool);
+    free(packed->offsets);
+    free(packed->lengths);
+    free(packed->hasargs);
+    free(packed->vals);
+    free(packed->flags);
+    free(packed->slots);
+    free(packed);
+}
+
+/* Slot for a long option name of length len in an index hash:  the slot
+ * holding it, or the free slot where it belongs
+ */
+static unsigned long index_slot(const struct ultragetopt_index *index,
+				const char *name, size_t len)
+{
+    unsigned long i = ultragetopt_hash(name, len, 0) & index->slotmask;
+
+    /* Linear probing, the table is at most half full */
+    while (index->slots[i] != 0) {
+	const char *longname = index->longopts[index->slots[i]-1].name;
+
+	if (optncmp(name, longname, len, getoptflags) == 0
+	    && longname[len] == '\0')
+	    break;
+	i = (i + 1) & index->slotmask;
+    }
+
+    return i;
+}
+
+struct ultragetopt_index *ultragetopt_index_create_table(int argc,
+	char *const argv[], const struct ultragetopt_table *table)
+{
+    struct ultragetopt_index *index;
+    struct ultragetopt_occurrence *longocc;
+    struct option *longopts;
+    struct ultragetopt_state state;
+    struct ultragetopt_table opts;
+    const char *shortopts;
+    unsigned long nslots;
+    size_t size, poolsize = 0;
+    char *shortcopy, *poolcopy;
+    int nlongopts = 0;
+    int i, c;
+
+    shortopts = table->shortopts != NULL ? table->shortopts : "";
+    while (*shortopts == '+' || *shortopts == '-' || *shortopts == ':')
+	shortopts++;
+
+    /* Names of packed options are copied, the pool moves as it grows */
+    if (table->packed != NULL) {
+	nlongopts = table->packed->count;
+	poolsize = table->packed->poolused;
+    } else if (table->longopts != NULL)
+	while (table->longopts[nlongopts].name != NULL)
+	    nlongopts++;
+    for (nslots = 1; nslots < 2 * (unsigned long)nlongopts; nslots <<= 1)
+	;
+
+    /* Allocate everything at once, ordered by alignment */
+    size = sizeof(*index)
+	+ sizeof(char *) * (argc + 1)
+	+ sizeof(struct option) * (nlongopts + 1)
+	+ sizeof(struct ultragetopt_occurrence) * nlongopts
+	+ sizeof(int) * nslots
+	+ strlen(shortopts) + 1
+	+ poolsize;
+    index = malloc(size);
+    if (index == NULL)
+	return NULL;
+
+    index->argv = (char **)(index + 1);
+    longopts = (struct option *)(index->argv + argc + 1);
+    longocc = (struct ultragetopt_occurrence *)(longopts + nlongopts + 1);
+    index->slots = (int *)(longocc + nlongopts);
+    shortcopy = (char *)(index->slots + nslots);
+    poolcopy = shortcopy + strlen(shortopts) + 1;
+
+    index->argc = argc;
+    for (i=0; i<argc; i++)
+	index->argv[i] = argv[i];
+    index->argv[argc] = NULL;
+
+    strcpy(shortcopy, shortopts);
+    index->shortopts = shortcopy;
+
+    /* Parse without storing to flag pointers, options with a flag return 0
+     * so that they are not taken for aliases of short options */
+    if (poolsize > 0)
+	memcpy(poolcopy, table->packed->pool, poolsize);
+    for (i=0; i<nlongopts; i++) {
+	if (table->packed != NULL) {
+	    longopts[i].name = poolcopy + table->packed->offsets[i];
+	    longopts[i].has_arg = longopt_hasarg(table, i);
+	    longopts[i].flag = longopt_flag(table, i);
+	    longopts[i].val = longopt_val(table, i);
+	} else
+	    longopts[i] = table->longopts[i];
+	if (longopts[i].flag != NULL) {
+	    longopts[i].flag = NULL;
+	    longopts[i].val = 0;
+	}
+    }
+    longopts[nlongopts].name = NULL;
+    longopts[nlongopts].has_arg = 0;
+    longopts[nlongopts].flag = NULL;
+    longopts[nlongopts].val = 0;
+    index->longopts = longopts;
+    index->nlongopts = nlongopts;
+
+    index->slotmask = nslots - 1;
+    for (i=0; i < (int)nslots; i++)
+	index->slots[i] = 0;
+    for (i=0; i<nlongopts; i++) {
+	const char *name = longopts[i].name;
+	unsigned long slot = index_slot(index, name, strlen(name));
+
+	/* Keep the first of duplicate names, as the parser does */
+	if (index->slots[slot] == 0)
+	    index->slots[slot] = i + 1;
+    }
+
+    ultragetopt_occurrences_init(&index->occurrences, longocc, nlongopts);
+
+    /* Parse the copy, packed options are now in longopts */
+    opts = *table;
+    opts.longopts = longopts;
+    opts.nlongopts = nlongopts;
+    opts.packed = NULL;
+    ultragetopt_state_init(&state);
+    state.opterr = 0;
+    state.occurrences = &index->occurrences;
+
+    index->errors = 0;
+    while ((c = ultragetopt_long_table_r(&state, argc, index->argv, &opts,
+					 NULL)) != -1)
+	if ((c == '?' || c == ':') && state.optname == NULL)
+	    index->errors++;
+    index->optind = state.optind;
+
+    return index;
+}
+
+struct ultragetopt_index *ultragetopt_index_create(int argc,
+	char *const argv[], const char *shortopts,
+	const struct option *longopts)
+{
+    struct ultragetopt_table opts;
+
+    init_table(&opts, shortopts, longopts);
+
+    return ultragetopt_index_create_table(argc, argv, &opts);
+}
+
+const struct ultragetopt_occurrence *ultragetopt_query(
+	const struct ultragetopt_index *index, const char *name)
+{
+    size_t len = strlen(name);
+    unsigned long slot;
+
+    if (index->nlongopts > 0) {
+	slot = index_slot(index, name, len);
+	if (index->slots[slot] != 0) {
+	    struct ultragetopt_table opts;
+	    int longind = index->slots[slot] - 1;
+	    int c;
+
+	    /* Aliases are recorded under their short option */
+	    init_table(&opts, index->shortopts, index->longopts);
+	    c = longopt_alias(&opts, longind);
+	    if (c != 0)
+		return &index->occurrences.shortopts[c];
+
+	    return &index->occurrences.longopts[longind];
+	}
+    }
+
+    if (len == 1 && name[0] != ':' && strchr(index->shortopts, name[0]))
+	return &index->occurrences.shortopts[(unsigned char)name[0]];
+
+    return NULL;
+}
+
+void ultragetopt_index_free(struct ultragetopt_index *index)
+{
+    free(index);
+}
+
+/* Parse held by a struct ultragetopt_cache */
+struct cache_entry {
+    struct cache_entry *hashnext;	/* Next entry in the same bucket */
+    struct cache_entry *newer;		/* Next more recently used entry */
+    struct cache_entry *older;		/* Next less recently used entry */
+    unsigned long hash;			/* Hash of key */
+    const struct ultragetopt_table *table;
+    const char *assigners;
+    const char *optleaders;
+    int flags;
+    size_t keylen;
+    char *key;				/* Key of the argv parsed, see
+					   cache_key() */
+    struct ultragetopt_parse parse;
+};
+
+struct ultragetopt_cache {
+    size_t maxentries;		/* Most entries to keep */
+    size_t nentries;		/* Entries currently kept */
+    unsigned long bucketmask;	/* Number of buckets - 1 */
+    struct cache_entry **buckets;	/* Hash chains of entries */
+    struct cache_entry *newest;	/* Most recently used entry */
+    struct cache_entry *oldest;	/* Least recently used entry */
+    struct cache_entry *uncached;	/* Last parse not kept (with errors) */
+    char *key;			/* Key of the argv being parsed */
+    size_t keysize;		/* Bytes allocated for key */
+    struct ultragetopt_parsed *parsed;	/* Options of the argv being
+					   parsed */
+    size_t parsedsize;		/* Entries allocated for parsed */
+};
+
+/* Build the cache key of argv in cache->key:  argc, every element which looks
+ * like an option in full, and the kind of every other element (which is all
+ * that the parser looks at).  Returns the length of the key, with its hash in
+ * *hash, or (size_t)-1 if memory could not be allocated.
+ * Every operand is part of the key, so argvs differing in the number of
+ * operands have different keys.
+ */
+static size_t cache_key(struct ultragetopt_cache *cache, int argc,
+			char *const argv[], const char *optleaders, int flags,
+			unsigned long *hash)
+{
+    unsigned long h = 0x811c9dc5UL ^ (unsigned long)flags;
+    size_t len = sizeof(argc);
+    size_t i;
+    int argi;
+
+    /* argc first, as elements after a NULL one are not in the key */
+    if (cache->keysize < len) {
+	char *key = realloc(cache->key, len * 2);
+
+	if (key == NULL)
+	    return (size_t)-1;
+	cache->key = key;
+	cache->keysize = len * 2;
+    }
+    memcpy(cache->key, &argc, sizeof(argc));
+
+    for (argi=1; argi<argc; argi++) {
+	const char *arg = argv[argi];
+	size_t arglen = 0;
+	char kind;
+
+	if (arg == NULL)
+	    kind = 'Z';				/* End of argv */
+	else if (like_option(arg, optleaders)) {
+	    kind = 'O';				/* Option, kept in full */
+	    arglen = strlen(arg) + 1;
+	} else if (like_optterm(arg, optleaders))
+	    kind = 'T';				/* Option terminator */
+	else
+	    kind = 'N';				/* Non-option */
+
+	if (len + 1 + arglen > cache->keysize) {
+	    size_t size = (len + 1 + arglen) * 2;
+	    char *key = realloc(cache->key, size);
+
+	    if (key == NULL)
+		return (size_t)-1;
+	    cache->key = key;
+	    cache->keysize = size;
+	}
+
+	cache->key[len++] = kind;
+	if (arglen > 0) {
+	    memcpy(cache->key + len, arg, arglen);
+	    len += arglen;
+	}
+
+	if (arg == NULL)
+	    break;
+    }
+
+    /* FNV-1a, case-sensitive unlike ultragetopt_hash() */
+    for (i=0; i<len; i++) {
+	h ^= (unsigned char)cache->key[i];
+	h = (h * 0x01000193UL) & 0xffffffffUL;
+    }
+
+    *hash = h;
+    return len;
+}
+
+/* Index in argv of an element of the copy parsed by cache_fill(), which is
+ * stored just before the text of the element
+ */
+static int cache_argindex(const char *arg)
+{
+    int index;
+
+    memcpy(&index, arg - sizeof(index), sizeof(index));
+    return index;
+}
+
+/* Remove an entry from the LRU list */
+static void cache_unlink(struct ultragetopt_cache *cache,
+			 struct cache_entry *entry)
+{
+    if (entry->newer != NULL)
+	entry->newer->older = entry->older;
+    else
+	cache->newest = entry->older;
+
+    if (entry->older != NULL)
+	entry->older->newer = entry->newer;
+    else
+	cache->oldest = entry->newer;
+}
+
+/* Add an entry to the LRU list as the most recently used */
+static void cache_link(struct ultragetopt_cache *cache,
+		       struct cache_entry *entry)
+{
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL)
+	cache->newest->newer = entry;
+    else
+	cache->oldest = entry;
+    cache->newest = entry;
+}
+
+/* Discard the least recently used entry */
+static void cache_evict(struct ultragetopt_cache *cache)
+{
+    struct cache_entry *entry = cache->oldest;
+    struct cache_entry **link = &cache->buckets[entry->hash
+						& cache->bucketmask];
+
+    while (*link != entry)
+	link = &(*link)->hashnext;
+    *link = entry->hashnext;
+
+    cache_unlink(cache, entry);
+    cache->nentries--;
+    free(entry);
+}
+
+/* Parse argv and store the result in a new entry (not yet in the cache)
+ * Returns the entry, or NULL if memory could not be allocated
+ */
+static struct cache_entry *cache_fill(struct ultragetopt_cache *cache,
+				      int argc, char *const argv[],
+				      const struct ultragetopt_table *table,
+				      const char *assigners,
+				      const char *optleaders, int flags,
+				      size_t keylen)
+{
+    struct ultragetopt_state state;
+    struct ultragetopt_parsed *parsed;
+    struct cache_entry *entry;
+    char **work;
+    char *text;
+    int *order;
+    size_t size;
+    int nparsed = 0, errors = 0;
+    int c, i;
+
+    /* Parse a copy of each element, leaving argv as it was.  The copies are
+     * distinct even where argv repeats a pointer, and each is preceded by its
+     * index in argv, so elements are found wherever they are permuted to. */
+    size = sizeof(char *) * (argc + 1);
+    for (i=0; i<argc; i++)
+	if (argv[i] != NULL)
+	    size += sizeof(int) + strlen(argv[i]) + 1;
+    work = malloc(size);
+    if (work == NULL)
+	return NULL;
+    text = (char *)(work + argc + 1);
+    for (i=0; i<argc; i++) {
+	size_t len;
+
+	/* NULL ends argv early, and is never permuted */
+	if (argv[i] == NULL) {
+	    work[i] = NULL;
+	    continue;
+	}
+
+	len = strlen(argv[i]) + 1;
+	memcpy(text, &i, sizeof(i));
+	work[i] = text + sizeof(i);
+	memcpy(work[i], argv[i], len);
+	text = work[i] + len;
+    }
+    work[argc] = NULL;
+
+    ultragetopt_state_init(&state);
+    state.opterr = ultraopterr;
+
+    while ((c = ultragetopt_tunable_r(&state, argc, work, table, NULL,
+				      assigners, optleaders, flags)) != -1) {
+	char *opt = work[state.curind];
+
+	if ((size_t)nparsed == cache->parsedsize) {
+	    size_t size = cache->parsedsize ? cache->parsedsize * 2 : 16;
+
+	    parsed = realloc(cache->parsed, sizeof(*parsed) * size);
+	    if (parsed == NULL) {
+		free(work);
+		return NULL;
+	    }
+	    cache->parsed = parsed;
+	    cache->parsedsize = size;
+	}
+
+	parsed = &cache->parsed[nparsed++];
+	parsed->opt = c;
+	parsed->longind = state.longind;
+	parsed->index = cache_argindex(opt);
+	parsed->argindex = -1;
+	parsed->argoffset = 0;
+	if (state.optarg != NULL) {
+	    if (state.optarg == work[state.curind+1])
+		parsed->argindex = cache_argindex(state.optarg);
+	    else {
+		/* Argument in the option element (e.g. -ofile) */
+		parsed->argindex = parsed->index;
+		parsed->argoffset = (size_t)(state.optarg - opt);
+	    }
+	}
+
+	if ((c == '?' || c == ':') && state.optname == NULL)
+	    errors++;
+    }
+
+    /* Allocate everything at once, ordered by alignment */
+    entry = malloc(sizeof(*entry)
+		   + sizeof(*parsed) * nparsed
+		   + sizeof(int) * argc
+		   + keylen);
+    if (entry == NULL) {
+	free(work);
+	return NULL;
+    }
+    parsed = (struct ultragetopt_parsed *)(entry + 1);
+    order = (int *)(parsed + nparsed);
+    entry->key = (char *)(order + argc);
+
+    for (i=0; i<nparsed; i++)
+	parsed[i] = cache->parsed[i];
+    for (i=0; i<argc; i++)
+	order[i] = work[i] != NULL ? cache_argindex(work[i]) : i;
+    memcpy(entry->key, cache->key, keylen);
+    free(work);
+
+    entry->table = table;
+    entry->assigners = assigners;
+    entry->optleaders = optleaders;
+    entry->keylen = keylen;
+    entry->parse.nparsed = nparsed;
+    entry->parse.parsed = parsed;
+    entry->parse.argc = argc;
+    entry->parse.order = order;
+    entry->parse.optind = state.optind;
+    entry->parse.errors = errors;
+
+    return entry;
+}
+
+struct ultragetopt_cache *ultragetopt_cache_create(size_t maxentries)
+{
+    struct ultragetopt_cache *cache;
+    unsigned long nbuckets;
+    unsigned long i;
+
+    for (nbuckets = 1; nbuckets < maxentries; nbuckets <<= 1)
+	;
+
+    cache = malloc(sizeof(*cache));
+    if (cache == NULL)
+	return NULL;
+
+    cache->buckets = malloc(sizeof(*cache->buckets) * nbuckets);
+    if (cache->buckets == NULL) {
+	free(cache);
+	return NULL;
+    }
+    for (i=0; i<nbuckets; i++)
+	cache->buckets[i] = NULL;
+
+    cache->maxentries = maxentries;
+    cache->nentries = 0;
+    cache->bucketmask = nbuckets - 1;
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    cache->uncached = NULL;
+    cache->key = NULL;
+    cache->keysize = 0;
+    cache->parsed = NULL;
+    cache->parsedsize = 0;
+
+    return cache;
+}
+
+const struct ultragetopt_parse *ultragetopt_cache_parse(
+	struct ultragetopt_cache *cache, int argc, char *const argv[],
+	const struct ultragetopt_table *table, const char *assigners,
+	const char *optleaders, int flags)
+{
+    const char *shortopts = table->shortopts;
+    struct cache_entry *entry;
+    unsigned long hash;
+    size_t keylen;
+    int keyflags;
+    int i;
+
+    free(cache->uncached);
+    cache->uncached = NULL;
+
+    /* Flags from shortopts and the environment are part of the key too */
+    keyflags = shortopts_flags(&shortopts, flags);
+    keylen = cache_key(cache, argc, argv, optleaders, keyflags, &hash);
+    if (keylen == (size_t)-1)
+	return NULL;
+
+    for (entry = cache->buckets[hash & cache->bucketmask]; entry != NULL;
+	 entry = entry->hashnext) {
+	if (entry->hash == hash
+	    && entry->table == table
+	    && entry->assigners == assigners
+	    && entry->optleaders == optleaders
+	    && entry->flags == keyflags
+	    && entry->keylen == keylen
+	    && memcmp(entry->key, cache->key, keylen) == 0)
+	    break;
+    }
+
+    if (entry != NULL) {
+	/* Store to flag pointers as parsing would */
+	for (i=0; i<entry->parse.nparsed; i++) {
+	    int longind = entry->parse.parsed[i].longind;
+
+	    if (longind >= 0 && longopt_flag(table, longind))
+		*longopt_flag(table, longind) = longopt_val(table, longind);
+	}
+
+	cache_unlink(cache, entry);
+	cache_link(cache, entry);
+	return &entry->parse;
+    }
+
+    entry = cache_fill(cache, argc, argv, table, assigners, optleaders, flags,
+		       keylen);
+    if (entry == NULL)
+	return NULL;
+    entry->hash = hash;
+    entry->flags = keyflags;
+
+    if (entry->parse.errors > 0 || cache->maxentries == 0) {
+	cache->uncached = entry;
+	return &entry->parse;
+    }
+
+    if (cache->nentries == cache->maxentries)
+	cache_evict(cache);
+
+    entry->hashnext = cache->buckets[hash & cache->bucketmask];
+    cache->buckets[hash & cache->bucketmask] = entry;
+    cache_link(cache, entry);
+    cache->nentries++;
+
+    return &entry->parse;
+}
+
+void ultragetopt_cache_free(struct ultragetopt_cache *cache)
+{
+    while (cache->oldest != NULL)
+	cache_evict(cache);
+
+    free(cache->uncached);
+    free(cache->buckets);
+    free(cache->key);
+    free(cache->parsed);
+    free(cache);
+}
+
+/* Read the whole of a configuration file into a single buffer
+ * Used where the file can not be mapped (or mmap() is not available)
+ */
+static int read_file(struct ultragetopt_file *file)
+{
+    FILE *fp;
+    char *data = NULL;
+    size_t size = 0, cap = 0;
+
+    fp = fopen(file->path, "rb");
+    if (fp == NULL)
+	return -1;
+
+    do {
+	if (size == cap) {
+	    char *newdata;
+
+	    cap = cap ? cap * 2 : 4096;
+	    newdata = realloc(data, cap + 1);	/* +1 for final '\0' */
+	    if (newdata == NULL) {
+		free(data);
+		fclose(fp);
+		return -1;
+	    }
+	    data = newdata;
+	}
+
+	size += fread(data + size, 1, cap - size, fp);
+    } while (size == cap);
+
+    if (ferror(fp)) {
+	free(data);
+	fclose(fp);
+	return -1;
+    }
+
+    fclose(fp);
+
+    data[size] = '\0';
+    file->data = data;
+    file->size = size;
+    return 0;
+}
+
+int ultragetopt_file_open(struct ultragetopt_file *file, const char *path)
+{
+#if HAVE_SYS_MMAN_H && HAVE_MMAP
+    struct stat st;
+    int fd;
+#endif
+
+    file->path = path;
+    file->data = NULL;
+    file->size = 0;
+    file->pos = 0;
+    file->line = 0;
+    file->mapped = 0;
+
+#if HAVE_SYS_MMAN_H && HAVE_MMAP
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return -1;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+	&& (size_t)st.st_size == (unsigned long long)st.st_size) {
+	size_t size = (size_t)st.st_size;
+	long pagesize = sysconf(_SC_PAGESIZE);
+	char *data;
+
+	/* Private writable mapping so lines can be terminated in place */
+	data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (data != MAP_FAILED) {
+	    /* The '\0' after the last line must fall inside the mapping,
+	     * either in place of its '\n' or in the zero-filled page tail */
+	    if (data[size-1] == '\n' || pagesize <= 0
+		|| size % (size_t)pagesize != 0) {
+		close(fd);
+		file->data = data;
+		file->size = size;
+		file->mapped = 1;
+		return 0;
+	    }
+
+	    munmap(data, size);
+	}
+    }
+
+    close(fd);
+#endif
+
+    return read_file(file);
+}
+
+/* Parse the next option line of a configuration file
+ * Names are looked up and options recorded as for the command line, only
+ * the syntax of the line (and so the checks of the value) differs
+ */
+static int file_instance(struct ultragetopt_state *state,
+			 struct ultragetopt_file *file,
+			 const struct ultragetopt_table *table,
+			 int *indexptr, const char *assigners, int flags)
+{
+    struct ultragetopt_table opts = *table;
+
+    if (assigners == NULL)
+	assigners = unixassigners;
+    if (opts.shortopts != NULL)
+	flags = shortopts_flags(&opts.shortopts, flags);
+
+    state->optarg = NULL;
+    state->optseps = NULL;
+    state->longind = -1;
+    state->optname = NULL;
+    state->curind = UGO_FROMFILE;
+
+    while (file->pos < file->size) {
+	char *line = file->data + file->pos;
+	char *end, *name, *value;
+	size_t namelen;
+	int longind = -1, optc = 0, has_arg;
+
+	end = memchr(line, '\n', file->size - file->pos);
+	if (end != NULL)
+	    file->pos = end - file->data + 1;
+	else {
+	    end = file->data + file->size;
+	    file->pos = file->size;
+	}
+	file->line++;
+
+	/* Trim trailing whitespace (including '\r') and terminate the line */
+	while (end > line && isspace((unsigned char)end[-1]))
+	    end--;
+	*end = '\0';
+
+	/* Skip leading whitespace, blank lines, and comments */
+	name = line;
+	while (isspace((unsigned char)*name))
+	    name++;
+	if (*name == '\0' || *name == '#')
+	    continue;
+
+	for (namelen = 0; name[namelen] != '\0'; namelen++)
+	    if (isspace((unsigned char)name[namelen])
+		|| strchr(assigners, name[namelen]))
+		break;
+
+	/* Find the value, NULL if there is no value */
+	value = name + namelen;
+	while (isspace((unsigned char)*value))
+	    value++;
+	if (*value != '\0' && strchr(assigners, *value)) {
+	    value++;
+	    while (isspace((unsigned char)*value))
+		value++;
+	} else if (*value == '\0')
+	    value = NULL;
+
+	if (opts.longopts != NULL || opts.packed != NULL)
+	    longind = find_longopt(&opts, name, namelen, flags);
+	if (longind >= 0)
+	    has_arg = longopt_hasarg(&opts, longind);
+	else if (namelen == 1)
+	    optc = find_shortopt(&opts, name[0], flags, &has_arg);
+
+	if (longind < 0 && optc == 0) {
+	    print_error(state->opterr, flags, errorfileopt, file->path,
+			file->line, (int)namelen, name);
+	    state->optopt = namelen == 1 ? name[0] : 0;
+	    return '?';
+	}
+
+	if (value != NULL && has_arg == no_argument) {
+	    print_error(state->opterr, flags, errorfilearg, file->path,
+			file->line, (int)namelen, name);
+	    state->optopt = longind >= 0 ? longopt_val(&opts, longind) : optc;
+	    return '?';
+	}
+
+	if (value == NULL && has_arg == required_argument) {
+	    print_error(state->opterr, flags, errorfilenoarg, file->path,
+			file->line, (int)namelen, name);
+	    state->optopt = longind >= 0 ? longopt_val(&opts, longind) : optc;
+	    return (flags & UGO_MISSINGCOLON) ? ':' : '?';
+	}
+
+	state->optarg = value;
+	if (longind >= 0)
+	    return found_longopt(state, &opts, longind, indexptr);
+	else
+	    return found_shortopt(state, &opts, optc, name);
+    }
+
+    return -1;
+}
+
+int ultragetopt_file(struct ultragetopt_file *file, const char *shortopts,
+		     const struct option *longopts, int *indexptr,
+		     const char *assigners, int flags)
+{
+    struct ultragetopt_table opts;
+
+    init_table(&opts, shortopts, longopts);
+
+    return ultragetopt_file_table(file, &opts, indexptr, assigners, flags);
+}
+
+int ultragetopt_file_table(struct ultragetopt_file *file,
+			   const struct ultragetopt_table *table,
+			   int *indexptr, const char *assigners, int flags)
+{
+    struct ultragetopt_state state;
+    int ret;
+
+    load_globals(&state);
+    ret = file_instance(&state, file, table, indexptr, assigners, flags);
+    store_globals(&state);
+
+    return ret;
+}
+
+int ultragetopt_file_r(struct ultragetopt_state *state,
+		       struct ultragetopt_file *file,
+		       const struct ultragetopt_table *table, int *indexptr,
+		       const char *assigners, int flags)
+{
+    return file_instance(state, file, table, indexptr, assigners, flags);
+}
+
+int ultragetopt_file_dispatch(struct ultragetopt_file *file,
+			      const struct ultragetopt_table *table,
+			      const struct ultragetopt_handlers *handlers,
+			      void *context, const char *assigners, int flags)
+{
+    struct ultragetopt_state state;
+
+    load_globals(&state);
+
+    for (;;) {
+	int longind = -1;
+	int c, ret;
+
+	c = file_instance(&state, file, table, &longind, assigners, flags);
+	store_globals(&state);
+
+	if (c == -1)
+	    return 0;
+
+	ret = dispatch_option(handlers, context, c, longind, state.optarg,
+			      flags);
+	if (ret != 0)
+	    return ret;
+    }
+}
+
+void ultragetopt_file_close(struct ultragetopt_file *file)
+{
+#if HAVE_SYS_MMAN_H && HAVE_MMAP
+    if (file->mapped)
+	munmap(file->data, file->size);
+    else
+#endif
+	free(file->data);
+
+    file->data = NULL;
+    file->size = 0;
+    file->pos = 0;
+    file->mapped = 0;
 }
 
 /* vim:set sts=4 sw=4: */
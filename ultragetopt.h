@@ -1,10 +1,15 @@
 
 /* define ULTRAGETOPT_REPLACE_GETOPT for ultragetopt*() to replace getopt*() */
 /* define ULTRAGETOPT_ONLY_DOS for ultragetopt*_dos() to replace ultragetopt*() */
+/* define ULTRAGETOPT_THREAD_LOCAL if ultragetopt was built with it (e.g. by
+ * configure --enable-thread-local) so the ultraopt* variables are per-thread */
 
 #ifndef INCLUDED_GETOPT_H
 #define INCLUDED_GETOPT_H 1
 
+#include <stddef.h>	/* size_t */
+#include <stdio.h>	/* FILE */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -20,6 +25,25 @@ extern "C" {
 # define ULTRAGETOPT_LINKAGE	extern
 #endif
 
+#ifdef ULTRAGETOPT_THREAD_LOCAL
+# if defined(_MSC_VER) && (defined(ULTRAGETOPT_DLL_IMPORT) || DLL_EXPORT)
+   /* MSVC can not import or export thread-local data from a DLL */
+#  error "ULTRAGETOPT_THREAD_LOCAL needs the static library with MSVC"
+# elif defined(__GNUC__)
+#  define ULTRAGETOPT_TLS	__thread
+# elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#  define ULTRAGETOPT_TLS	_Thread_local
+# elif defined(__cplusplus) && __cplusplus >= 201103L
+#  define ULTRAGETOPT_TLS	thread_local
+# elif defined(_MSC_VER)
+#  define ULTRAGETOPT_TLS	__declspec(thread)
+# else
+#  error "No thread-local storage class known for this compiler"
+# endif
+#else
+# define ULTRAGETOPT_TLS
+#endif /* ULTRAGETOPT_THREAD_LOCAL */
+
 /* Flag values to pass to getopt_tunable() */
 #define UGO_CASEINSENSITIVE	0x1
 #define UGO_SINGLELEADERLONG	0x2
@@ -48,8 +72,373 @@ struct option {
 };
 #endif /* required_argument */
 
-ULTRAGETOPT_LINKAGE char *ultraoptarg;
-ULTRAGETOPT_LINKAGE int ultraoptind, ultraopterr, ultraoptopt, ultraoptreset;
+/* Node of a compressed trie of case-folded long option names
+ * Node 0 is the root.  Each other node is reached from its parent by an edge
+ * labelled with one or more characters, and the labels of the children of a
+ * node start with different characters.
+ */
+struct ultragetopt_trienode {
+    int label;		/* Offset of the label of the edge to this node in
+			   the table's trielabels */
+    int labellen;	/* Length of the label */
+    int longind;	/* Long option whose name ends here, or -1 */
+    int child;		/* Index of the first child (children are
+			   consecutive) */
+    int nchildren;	/* Number of children */
+};
+
+/* Slot of the hash of a packed option table */
+struct ultragetopt_packedslot {
+    unsigned int hash;		/* ultragetopt_hash() of the name */
+    unsigned int longind;	/* Long option + 1, 0 if the slot is empty */
+};
+
+/* Long options registered at runtime, for very large option sets
+ * Rather than a struct option (and a separate name) for each, the names are
+ * packed into one string pool, addressed by 32-bit offsets and lengths, and
+ * the other fields are kept in parallel arrays.  Lookups probe an open
+ * addressing hash holding the full hash of each name, so mismatches are
+ * rejected without touching the pool.  Options may be registered at any
+ * time with ultragetopt_packed_add(), but names move as the pool grows, so
+ * ultragetopt_state.optname is only valid until the next registration.
+ * Parse with a table filled by ultragetopt_packed_table().
+ */
+struct ultragetopt_packed {
+    char *pool;			/* NUL-terminated names */
+    unsigned int poolused;	/* Bytes of pool used */
+    unsigned int poolsize;	/* Bytes in pool */
+    unsigned int *offsets;	/* Offset of each name in pool */
+    unsigned int *lengths;	/* Length of each name */
+    unsigned char *hasargs;	/* has_arg of each option */
+    int *vals;			/* val of each option */
+    int **flags;		/* flag of each option, NULL until an option
+				   with a flag is registered */
+    int count;			/* Options registered */
+    int size;			/* Options the arrays have room for */
+    struct ultragetopt_packedslot *slots;
+    unsigned long slotmask;	/* Slots - 1 (at most half are used) */
+};
+
+/* Option set with precomputed lookup structures, normally generated by
+ * ultragetopt-gen so that no table work is done at startup
+ * Any of the lookup members may be NULL to use a linear search instead
+ */
+struct ultragetopt_table {
+    const char *shortopts;		/* As for ultragetopt_long() */
+    const struct option *longopts;	/* As for ultragetopt_long() */
+    int nlongopts;			/* Entries in longopts (excluding
+					   the terminating entry) */
+    const size_t *namelens;		/* strlen() of each long name */
+    const int *hashdisp;		/* Minimal perfect hash of long names:
+					   displacement for each bucket */
+    const int *hashslots;		/* longind for each hash slot */
+    const unsigned char *shortargs;	/* 256 entries: has_arg+1 for each
+					   short option character, else 0 */
+    const char *const *shortseps;	/* 256 entries: list separators for
+					   each short option character, or
+					   NULL if its argument is not a list
+					   (see ultragetopt_split()) */
+    const char *const *longseps;	/* List separators for each long
+					   option (by longind), or NULL */
+    const struct ultragetopt_trienode *trie;	/* Trie of long names, for
+						   longest-prefix matching */
+    const char *trielabels;		/* Labels of trie edges (lowercase) */
+    const struct ultragetopt_packed *packed;	/* Long options, in place of
+						   longopts (which is then
+						   NULL), or NULL */
+};
+
+/* argv index given to options read from a configuration file by
+ * ultragetopt_file(), which are not in argv */
+#define UGO_FROMFILE	(-2)
+
+/* Occurrences of a single option */
+struct ultragetopt_occurrence {
+    int count;		/* Number of times the option was given (e.g. -vvv) */
+    int first;		/* argv index of the first occurrence, -1 if none, or
+			   UGO_FROMFILE */
+    int last;		/* argv index of the last occurrence, -1 if none, or
+			   UGO_FROMFILE */
+    char *arg;		/* Argument to the last occurrence, if any */
+};
+
+/* Occurrence index of all options, updated by the getopt functions while
+ * ultraoptoccur points to it
+ * A long option without a flag whose val is a short option character (as
+ * {"verbose", no_argument, NULL, 'v'} with 'v' in shortopts) is an alias of
+ * that short option, and both are recorded under the short option.
+ */
+struct ultragetopt_occurrences {
+    /* Short options, indexed by (unsigned char) option character */
+    struct ultragetopt_occurrence shortopts[256];
+    /* Long options, indexed by longind (provided by the caller) */
+    struct ultragetopt_occurrence *longopts;
+    int nlongopts;
+};
+
+/* Parse event kinds recorded in a struct ultragetopt_trace */
+#define UGO_TRACE_CLASSIFY	1	/* argv[index] looked at, value is one
+					   of the UGO_TRACE_IS* kinds below */
+#define UGO_TRACE_LONG		2	/* argv[index] matched long option
+					   value (its longind) */
+#define UGO_TRACE_SHORT		3	/* argv[index] contains short option
+					   value (its character) */
+#define UGO_TRACE_ARGUMENT	4	/* Argument taken from argv[index], at
+					   offset value */
+#define UGO_TRACE_PERMUTE	5	/* argv[index] moved to argv[value] */
+#define UGO_TRACE_ERROR		6	/* Error for argv[index], value is the
+					   returned '?' or ':' */
+#define UGO_TRACE_END		7	/* Parsing ended, index is optind */
+
+#define UGO_TRACE_ISOPTION	1
+#define UGO_TRACE_ISTERMINATOR	2
+#define UGO_TRACE_ISOPERAND	3
+
+/* Parse event */
+struct ultragetopt_event {
+    unsigned char kind;	/* UGO_TRACE_* */
+    int index;		/* argv index the event concerns */
+    int value;		/* Depends on kind, see UGO_TRACE_* */
+};
+
+/* Ring buffer of the most recent parse events, recorded by the getopt
+ * functions while ultraopttrace (or the trace of a struct ultragetopt_state)
+ * points to it.  Recording is a few stores per event and does not lock, so it
+ * can be left enabled.  A trace must only be used by one thread:  give each
+ * thread its own, and dump it from the thread recording into it (or once
+ * that thread has finished parsing).
+ */
+struct ultragetopt_trace {
+    struct ultragetopt_event *events;	/* Buffer of events, or NULL to
+					   record nothing */
+    unsigned long mask;			/* Size of events - 1 */
+    unsigned long next;			/* Number of events ever recorded */
+};
+
+/* Start a trace recording into events
+ * nevents - size of events, rounded down to a power of two (if it is 0,
+ *	     the trace records nothing and events is not written)
+ */
+ULTRAGETOPT_LINKAGE void ultragetopt_trace_init(
+	struct ultragetopt_trace *trace, struct ultragetopt_event *events,
+	size_t nevents);
+
+/* Write the events in a trace, oldest first, to out as a JSON array
+ * Returns 0 on success, -1 on write error
+ */
+ULTRAGETOPT_LINKAGE int ultragetopt_trace_dump(
+	const struct ultragetopt_trace *trace, FILE *out);
+
+/* Positions of the elements of argv which look like options (or option
+ * terminators), found by ultragetopt_classify() so that the getopt functions
+ * need not look at the non-options when permuting.  Used while
+ * ultraoptclasses (or the classes of a struct ultragetopt_state) points to
+ * it, which must be for the argv and optleaders it was made from (classes
+ * for a different argc are ignored).  Setting ultraoptreset starts the
+ * classes over along with the parse.
+ */
+struct ultragetopt_classes {
+    int argc;		/* Elements of argv classified */
+    int *options;	/* argv indexes of the options, ascending */
+    int noptions;	/* Entries in options */
+    int next;		/* Entry in options the parser looks at next (0 to
+			   start over) */
+};
+
+/* Classify the elements of argv using nthreads threads (0 for one per
+ * processor), each taking a contiguous part of argv.  Parts are too large for
+ * threads to be worthwhile unless argv has hundreds of thousands of elements,
+ * and threads are only used where POSIX threads are available.
+ * optleaders - as for ultragetopt_tunable() ("-" for the getopt functions
+ *		other than the _dos ones)
+ * Returns the classes, or NULL if memory could not be allocated
+ */
+ULTRAGETOPT_LINKAGE struct ultragetopt_classes *ultragetopt_classify(
+	int argc, char *const argv[], const char *optleaders, int nthreads);
+
+ULTRAGETOPT_LINKAGE void ultragetopt_classes_free(
+	struct ultragetopt_classes *classes);
+
+/* Kinds of struct ultragetopt_constraint */
+#define UGO_CONFLICT	1	/* At most one of the options may be given */
+#define UGO_REQUIRE	2	/* If the first option is given, so must the
+				   others be */
+#define UGO_ONEOF	3	/* Exactly one of the options must be given */
+#define UGO_ANYOF	4	/* At least one of the options must be given */
+
+/* Constraint on the combination of options given, declared alongside the
+ * option table, e.g. { UGO_CONFLICT, "quiet verbose" }.  An array of them
+ * ends with an entry of kind 0.
+ */
+struct ultragetopt_constraint {
+    int kind;			/* UGO_CONFLICT, UGO_REQUIRE, etc. */
+    const char *options;	/* Space-separated long option names and short
+				   option characters */
+};
+
+/* Constraints compiled into bitsets by ultragetopt_constraints_create()
+ * While ultraoptconstraints (or the constraints of a struct
+ * ultragetopt_state) points to them, the getopt functions record the options
+ * given and check the constraints once all options are parsed, printing an
+ * error and returning '?' (once) rather than -1 if any are violated.
+ */
+struct ultragetopt_constraints {
+    const struct ultragetopt_constraint *constraints;
+    int nconstraints;		/* Entries in constraints */
+    const struct option *longopts;
+    int nlongopts;		/* Entries in longopts */
+    int nwords;			/* unsigned longs in each bitset */
+    int shortbits[256];		/* Bit of each short option character, or
+				   -1 (long options use bit longind) */
+    unsigned long *masks;	/* Options of each constraint */
+    unsigned long *firsts;	/* First option of each constraint */
+    unsigned long *seen;	/* Options given */
+    int checked;		/* Have the constraints been checked? */
+};
+
+/* Compile constraints for the options in shortopts and longopts
+ * A short option which is the val of a long option without a flag (as for
+ * { "verbose", no_argument, NULL, 'v' }) counts as that long option.
+ * Returns the compiled constraints, or NULL if memory could not be allocated
+ * or a constraint names an unknown option (reported on stderr)
+ */
+ULTRAGETOPT_LINKAGE struct ultragetopt_constraints
+	*ultragetopt_constraints_create(
+	const struct ultragetopt_constraint *constraints,
+	const char *shortopts, const struct option *longopts);
+
+/* Forget the options given, to check constraints on another argv */
+ULTRAGETOPT_LINKAGE void ultragetopt_constraints_reset(
+	struct ultragetopt_constraints *constraints);
+
+ULTRAGETOPT_LINKAGE void ultragetopt_constraints_free(
+	struct ultragetopt_constraints *constraints);
+
+/* Arguments given for one accumulated option, in the order given */
+struct ultragetopt_valuelist {
+    char **values;		/* The arguments (pointers into argv) */
+    int count;			/* Entries in values */
+    int size;			/* Entries values has room for */
+};
+
+/* Arguments of options which may be repeated (-I dir, --define k=v), created
+ * by ultragetopt_values_create().  While ultraoptvalues (or the values of a
+ * struct ultragetopt_state) points to it, the getopt functions append the
+ * argument of each accumulated option given to its list.  Lists grow by
+ * doubling inside an arena:  the caller's buffer while it has room, then
+ * blocks allocated as needed, all released by ultragetopt_values_free().
+ */
+struct ultragetopt_values {
+    const struct option *longopts;
+    int nlongopts;		/* Entries in longopts */
+    int shortlists[256];	/* List of each short option character, or -1 */
+    int *longlists;		/* List of each long option, or -1 */
+    struct ultragetopt_valuelist *lists;
+    int nlists;			/* Entries in lists */
+    char *arena;		/* Block lists are allocated from */
+    size_t arenasize;		/* Bytes in arena */
+    size_t arenaused;		/* Bytes of arena allocated */
+    void *blocks;		/* Blocks allocated for the arena */
+    void *buffer;		/* Arena supplied by the caller, or NULL */
+    size_t buffersize;		/* Bytes in buffer */
+    int failed;			/* Was an argument dropped for lack of memory? */
+};
+
+/* Create lists for the options named in accumulate (space-separated long
+ * option names and short option characters, as for constraints) from
+ * shortopts and longopts.  A short option which is the val of a long option
+ * without a flag shares its list.  Lists are allocated from the arenasize
+ * bytes at arena (suitably aligned for pointers, may be NULL) until it is
+ * full, then from internal blocks.
+ * Returns the lists, or NULL if memory could not be allocated or accumulate
+ * names an unknown option (reported on stderr)
+ */
+ULTRAGETOPT_LINKAGE struct ultragetopt_values *ultragetopt_values_create(
+	const char *accumulate, const char *shortopts,
+	const struct option *longopts, void *arena, size_t arenasize);
+
+/* Arguments given for the option name (long option name or short option
+ * character), *count set to their number, or NULL if none were given or the
+ * option does not accumulate
+ */
+ULTRAGETOPT_LINKAGE char **ultragetopt_values_get(
+	const struct ultragetopt_values *values, const char *name,
+	int *count);
+
+/* Empty every list and release the arena, to parse another argv */
+ULTRAGETOPT_LINKAGE void ultragetopt_values_reset(
+	struct ultragetopt_values *values);
+
+ULTRAGETOPT_LINKAGE void ultragetopt_values_free(
+	struct ultragetopt_values *values);
+
+/* Create an empty packed option table
+ * Returns the table, or NULL if memory could not be allocated
+ */
+ULTRAGETOPT_LINKAGE struct ultragetopt_packed *ultragetopt_packed_create(
+	void);
+
+/* Register a long option, with the fields of a struct option
+ * Returns its index (as longind), or -1 if it is already registered or
+ * memory could not be allocated
+ */
+ULTRAGETOPT_LINKAGE int ultragetopt_packed_add(
+	struct ultragetopt_packed *packed, const char *name, int has_arg,
+	int *flag, int val);
+
+/* Index of the long option name, or -1 if it is not registered */
+ULTRAGETOPT_LINKAGE int ultragetopt_packed_find(
+	const struct ultragetopt_packed *packed, const char *name);
+
+/* Fill table to parse shortopts and the long options of packed
+ * (constraints and value lists, which name long options through struct
+ * option, see only the short options)
+ */
+ULTRAGETOPT_LINKAGE void ultragetopt_packed_table(
+	const struct ultragetopt_packed *packed, const char *shortopts,
+	struct ultragetopt_table *table);
+
+ULTRAGETOPT_LINKAGE void ultragetopt_packed_free(
+	struct ultragetopt_packed *packed);
+
+ULTRAGETOPT_LINKAGE ULTRAGETOPT_TLS char *ultraoptarg;
+ULTRAGETOPT_LINKAGE ULTRAGETOPT_TLS int ultraoptind, ultraopterr, ultraoptopt,
+	ultraoptreset;
+ULTRAGETOPT_LINKAGE ULTRAGETOPT_TLS struct ultragetopt_occurrences
+	*ultraoptoccur;
+ULTRAGETOPT_LINKAGE ULTRAGETOPT_TLS const char *ultraoptseps;
+ULTRAGETOPT_LINKAGE ULTRAGETOPT_TLS struct ultragetopt_trace *ultraopttrace;
+ULTRAGETOPT_LINKAGE ULTRAGETOPT_TLS struct ultragetopt_classes
+	*ultraoptclasses;
+ULTRAGETOPT_LINKAGE ULTRAGETOPT_TLS struct ultragetopt_constraints
+	*ultraoptconstraints;
+ULTRAGETOPT_LINKAGE ULTRAGETOPT_TLS struct ultragetopt_values *ultraoptvalues;
+
+/* Element of a list argument:  len characters at ptr, not NUL-terminated */
+struct ultragetopt_span {
+    const char *ptr;
+    size_t len;
+};
+
+/* Split a list argument (e.g. -Ipath1:path2 or --include=a,b,c) in place
+ * Set *pos to the argument (ultraoptarg) and call repeatedly, each call
+ * stores the next element in *span and returns 1, or returns 0 once there
+ * are no more elements.  Empty elements are returned, so "a,,b" has three
+ * elements and "" has one.  Nothing is allocated and the argument is not
+ * modified.
+ * separators - characters separating elements, normally ultraoptseps (the
+ *		separators declared for the last option in its table), or
+ *		NULL to return the whole argument as a single element
+ */
+ULTRAGETOPT_LINKAGE int ultragetopt_split(const char **pos,
+	const char *separators, struct ultragetopt_span *span);
+
+/* Clear an occurrence index before parsing
+ * longocc - array of nlongopts entries for long options (may be NULL)
+ */
+ULTRAGETOPT_LINKAGE void ultragetopt_occurrences_init(
+	struct ultragetopt_occurrences *occ,
+	struct ultragetopt_occurrence *longocc, int nlongopts);
 
 ULTRAGETOPT_LINKAGE int ultragetopt(int argc, char *const argv[],
 	const char *optstring);
@@ -78,6 +467,263 @@ ULTRAGETOPT_LINKAGE int ultragetopt_tunable(int argc, char *const argv[],
 	const char *shortopts, const struct option *longopts, int *indexptr,
 	const char *assigners, const char *optleaders, int flags);
 
+/* State of a configuration file being read by ultragetopt_file() */
+struct ultragetopt_file {
+    const char *path;	/* Name of the file (used in error messages) */
+    char *data;		/* Contents of the file (mapped or read) */
+    size_t size;	/* Size of the contents, in bytes */
+    size_t pos;		/* Offset of the next line to parse */
+    int line;		/* Line number of the last line parsed */
+    int mapped;		/* Is data memory-mapped? */
+};
+
+/* Open a configuration file for reading by ultragetopt_file()
+ * Returns 0 on success, -1 (with errno set) on failure
+ */
+ULTRAGETOPT_LINKAGE int ultragetopt_file_open(struct ultragetopt_file *file,
+	const char *path);
+
+/* Getopt over the lines of a configuration file rather than argv
+ * Each line is "name=value" or "name value" where name is a long option or a
+ * single short option character.  Blank lines and lines starting with '#'
+ * are ignored.  Returns the same values as ultragetopt_tunable() with
+ * ultraoptarg pointing into the file contents (which are modified in place,
+ * never written back to the file).  Read the file before argv so that options
+ * given on the command line take precedence.
+ * Options are looked up and recorded (occurrences, constraints, value lists)
+ * as on the command line, with UGO_FROMFILE as their argv index.  Errors are
+ * reported as "path:line: ...".
+ * assigners - characters accepted between name and value, in addition to
+ *	       whitespace (NULL for the default)
+ * flags - UGO_CASEINSENSITIVE, UGO_NOPRINTERR, and UGO_MISSINGCOLON are
+ *	   honored
+ */
+ULTRAGETOPT_LINKAGE int ultragetopt_file(struct ultragetopt_file *file,
+	const char *shortopts, const struct option *longopts, int *indexptr,
+	const char *assigners, int flags);
+
+/* ultragetopt_file() taking a precomputed option table */
+ULTRAGETOPT_LINKAGE int ultragetopt_file_table(struct ultragetopt_file *file,
+	const struct ultragetopt_table *table, int *indexptr,
+	const char *assigners, int flags);
+
+/* Release the contents of a configuration file
+ * Invalidates any ultraoptarg values returned by ultragetopt_file()
+ */
+ULTRAGETOPT_LINKAGE void ultragetopt_file_close(struct ultragetopt_file *file);
+
+/* Parsing state for the reentrant (_r) getopt functions, which use it in
+ * place of the ultraopt* variables so that any number of parsers can run
+ * at once.  Initialize with ultragetopt_state_init().
+ */
+struct ultragetopt_state {
+    char *optarg;	/* As ultraoptarg */
+    int optind;		/* As ultraoptind */
+    int opterr;		/* As ultraopterr */
+    int optopt;		/* As ultraoptopt */
+    int optreset;	/* As ultraoptreset */
+    int optnum;		/* Options processed in the current argv element */
+    int longind;	/* Index of the last long option returned, else -1 */
+    int curind;		/* argv index of the last option (or error), or
+			   UGO_FROMFILE */
+    char *optname;	/* Name of the last option returned (the long option
+			   name, or the short option character in argv),
+			   NULL after an error */
+    struct ultragetopt_occurrences *occurrences; /* As ultraoptoccur */
+    struct ultragetopt_trace *trace;	/* As ultraopttrace */
+    struct ultragetopt_classes *classes;	/* As ultraoptclasses */
+    struct ultragetopt_constraints *constraints; /* As ultraoptconstraints */
+    struct ultragetopt_values *values;	/* As ultraoptvalues */
+    const char *optseps;	/* As ultraoptseps */
+};
+
+ULTRAGETOPT_LINKAGE void ultragetopt_state_init(
+	struct ultragetopt_state *state);
+
+ULTRAGETOPT_LINKAGE int ultragetopt_long_r(struct ultragetopt_state *state,
+	int argc, char *const argv[], const char *shortopts,
+	const struct option *longopts, int *indexptr);
+
+ULTRAGETOPT_LINKAGE int ultragetopt_long_table_r(
+	struct ultragetopt_state *state, int argc, char *const argv[],
+	const struct ultragetopt_table *table, int *indexptr);
+
+ULTRAGETOPT_LINKAGE int ultragetopt_tunable_r(struct ultragetopt_state *state,
+	int argc, char *const argv[], const struct ultragetopt_table *table,
+	int *indexptr, const char *assigners, const char *optleaders,
+	int flags);
+ULTRAGETOPT_LINKAGE int ultragetopt_file_r(struct ultragetopt_state *state,
+	struct ultragetopt_file *file, const struct ultragetopt_table *table,
+	int *indexptr, const char *assigners, int flags);
+
+/* Handler for an option found by ultragetopt_dispatch()
+ * context - as passed to ultragetopt_dispatch()
+ * opt - value the getopt functions would return for the option
+ * longind - index of the long option, or -1 if it is not a long option
+ * arg - argument to the option, or NULL if it has none
+ * Returns 0 to continue parsing, non-zero to stop
+ */
+typedef int (*ultragetopt_handler)(void *context, int opt, int longind,
+	char *arg);
+
+/* Handlers for ultragetopt_dispatch(), any of which may be NULL */
+struct ultragetopt_handlers {
+    /* Short options, indexed by (unsigned char) option character (256
+     * entries).  Also used for long options without a long handler, indexed
+     * by their val (as for GNU getopt {"verbose", no_argument, NULL, 'v'}) */
+    const ultragetopt_handler *shorthandlers;
+    /* Long options, indexed by longind (one per longopts entry) */
+    const ultragetopt_handler *longhandlers;
+    /* Unrecognized options or missing arguments, opt is '?' or ':' and
+     * ultraoptopt is set as for the getopt functions */
+    ultragetopt_handler error;
+    /* Non-option arguments when shortopts starts with '-' (opt is 1) */
+    ultragetopt_handler operand;
+};
+
+/* Parse all of argv as ultragetopt_long() would, calling the handler for
+ * each option rather than returning it.  Setup is done once per call rather
+ * than once per option.  Options without a handler are skipped (e.g. those
+ * which only set a flag).
+ * Returns 0 once all options are parsed (ultraoptind is then the index of the
+ * first non-option argument), or the first non-zero value returned by a
+ * handler, or '?' or ':' for an error when there is no error handler.
+ */
+ULTRAGETOPT_LINKAGE int ultragetopt_dispatch(int argc, char *const argv[],
+	const char *shortopts, const struct option *longopts,
+	const struct ultragetopt_handlers *handlers, void *context);
+
+/* ultragetopt_dispatch() taking a precomputed option table */
+ULTRAGETOPT_LINKAGE int ultragetopt_dispatch_table(int argc,
+	char *const argv[], const struct ultragetopt_table *table,
+	const struct ultragetopt_handlers *handlers, void *context);
+
+/* ultragetopt_dispatch() over the lines of a configuration file, read as
+ * ultragetopt_file_table() reads them
+ */
+ULTRAGETOPT_LINKAGE int ultragetopt_file_dispatch(
+	struct ultragetopt_file *file, const struct ultragetopt_table *table,
+	const struct ultragetopt_handlers *handlers, void *context,
+	const char *assigners, int flags);
+
+/* Getopt functions taking a precomputed option table
+ * Behave as ultragetopt_long() and ultragetopt_tunable() respectively
+ */
+ULTRAGETOPT_LINKAGE int ultragetopt_long_table(int argc, char *const argv[],
+	const struct ultragetopt_table *table, int *indexptr);
+
+ULTRAGETOPT_LINKAGE int ultragetopt_tunable_table(int argc,
+	char *const argv[], const struct ultragetopt_table *table,
+	int *indexptr, const char *assigners, const char *optleaders,
+	int flags);
+
+/* Hash of the first len characters of a long option name, ignoring case
+ * This is the hash function used in struct ultragetopt_table
+ */
+ULTRAGETOPT_LINKAGE unsigned long ultragetopt_hash(const char *name,
+	size_t len, unsigned long seed);
+
+/* Options of an argv parsed once by ultragetopt_index_create(), for lookup
+ * by name at any later point.  It is not modified after it is created, so
+ * any number of threads may query it at once.
+ */
+struct ultragetopt_index {
+    int argc;		/* Elements in argv */
+    char **argv;	/* Copy of argv, permuted as ultragetopt_long() would
+			   (the argv passed in is not modified).  Occurrence
+			   indexes refer to this copy. */
+    int optind;		/* Index of the first non-option argument in argv */
+    int errors;		/* Unrecognized options and missing arguments */
+    const char *shortopts;	/* Copy of shortopts, without leading flag
+				   characters */
+    const struct option *longopts;	/* Copy of longopts, without flags
+					   (val is 0 where there was one) */
+    int nlongopts;	/* Entries in longopts */
+    struct ultragetopt_occurrences occurrences;	/* Occurrences of each
+						   option */
+    int *slots;		/* Hash of long names:  longind+1, or 0 if free */
+    unsigned long slotmask;	/* Number of slots - 1 */
+};
+
+/* Parse all of argv as ultragetopt_long() would, without printing errors or
+ * storing to flag pointers, into a new index
+ * Returns the index, or NULL if memory could not be allocated
+ */
+ULTRAGETOPT_LINKAGE struct ultragetopt_index *ultragetopt_index_create(
+	int argc, char *const argv[], const char *shortopts,
+	const struct option *longopts);
+
+ULTRAGETOPT_LINKAGE struct ultragetopt_index *ultragetopt_index_create_table(
+	int argc, char *const argv[], const struct ultragetopt_table *table);
+
+/* Look up the occurrences of an option in an index
+ * name - long option name, or a single short option character (when there
+ *	  is no long option of that name)
+ * Returns the occurrences (count is 0 if the option was not given), or NULL
+ * if name is not an option.  A long option and the short option it is an
+ * alias of share their occurrences.
+ */
+ULTRAGETOPT_LINKAGE const struct ultragetopt_occurrence *ultragetopt_query(
+	const struct ultragetopt_index *index, const char *name);
+
+ULTRAGETOPT_LINKAGE void ultragetopt_index_free(
+	struct ultragetopt_index *index);
+
+/* Option (or error) found by ultragetopt_cache_parse() */
+struct ultragetopt_parsed {
+    int opt;		/* Value ultragetopt_tunable() returned for it */
+    int longind;	/* Index of the long option, or -1 */
+    int index;		/* Index in argv of the option */
+    int argindex;	/* Index in argv of the argument, or -1 if none */
+    size_t argoffset;	/* Offset of the argument in argv[argindex] (e.g. 2
+			   for -ofile) */
+};
+
+/* Result of parsing all of argv with ultragetopt_cache_parse()
+ * Indexes refer to argv as passed in, which is not modified
+ */
+struct ultragetopt_parse {
+    int nparsed;	/* Options (and errors) found, in order */
+    const struct ultragetopt_parsed *parsed;
+    int argc;		/* Entries in order */
+    const int *order;	/* Permutation ultragetopt_tunable() would apply:
+			   order[i] is the index in argv of the argument it
+			   would move to argv[i] */
+    int optind;		/* ultraoptind after parsing (the non-option
+			   arguments are argv[order[optind]] onwards) */
+    int errors;		/* Unrecognized options and missing arguments */
+};
+
+/* Cache of parses, see ultragetopt_cache_parse() */
+struct ultragetopt_cache;
+
+/* Create a cache holding at most maxentries parses
+ * Returns the cache, or NULL if memory could not be allocated
+ */
+ULTRAGETOPT_LINKAGE struct ultragetopt_cache *ultragetopt_cache_create(
+	size_t maxentries);
+
+/* Parse all of argv as ultragetopt_tunable_table() would, reusing the result
+ * of an earlier call with the same table, assigners, optleaders, and flags,
+ * and an argv which differs only in non-option arguments (including option
+ * arguments in separate argv elements which do not look like options).
+ * argc and the number of non-option arguments must be the same, so argvs
+ * with a different number of trailing operands are parsed separately.
+ * The least recently used parse is discarded when the cache is full.
+ * Parses with errors are not cached, so their messages are printed each time.
+ * Flag pointers in longopts are stored to, as when parsing.  The table,
+ * assigners, and optleaders must not change while they are in the cache.
+ * Returns the parse, which is valid until the next call with this cache, or
+ * NULL if memory could not be allocated
+ */
+ULTRAGETOPT_LINKAGE const struct ultragetopt_parse *ultragetopt_cache_parse(
+	struct ultragetopt_cache *cache, int argc, char *const argv[],
+	const struct ultragetopt_table *table, const char *assigners,
+	const char *optleaders, int flags);
+
+ULTRAGETOPT_LINKAGE void ultragetopt_cache_free(
+	struct ultragetopt_cache *cache);
+
 #ifdef ULTRAGETOPT_REPLACE_GETOPT
 # define optarg ultraoptarg
 # define optind ultraoptind
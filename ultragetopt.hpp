@@ -0,0 +1,198 @@
+/* C++ interface to ultragetopt
+ *
+ * ugo::parser presents the options in argv as a range of items which can be
+ * used in range-based for loops and with <algorithm>:
+ *
+ *	ugo::parser opts(argc, argv, "vo:", longopts);
+ *	for (const ugo::item &opt : opts) {
+ *	    switch (opt.id) { ... }
+ *	}
+ *	for (int i = opts.optind(); i < argc; i++)
+ *	    ... non-option argument argv[i] ...
+ *
+ * Each parser keeps its own state (see ultragetopt_long_r()), so any number
+ * may be used at once, and nothing is allocated.  Names and arguments are
+ * views of argv or of the longopts names.  Parsing permutes argv as
+ * ultragetopt_long() does, so a parser can only be iterated once (its
+ * iterators are input iterators).
+ *
+ * Requires C++17 (for std::string_view and std::optional).
+ *
+ * This file is part of ultragetopt, see COPYING for licensing details
+ */
+
+#ifndef INCLUDED_ULTRAGETOPT_HPP
+#define INCLUDED_ULTRAGETOPT_HPP 1
+
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <string_view>
+
+#include "ultragetopt.h"
+
+namespace ugo {
+
+/* An option (or error) found in argv */
+struct item {
+    int id;		/* Value ultragetopt_long() would return */
+    int longind;	/* Index of the long option, or -1 */
+    std::string_view name;	/* Long option name or short option
+				   character, empty for errors and for
+				   non-options (id 1, see UGO_NONOPTARG) */
+    std::optional<std::string_view> arg;	/* Argument, if any */
+    int index;		/* Index of the option (or error) in argv */
+
+    /* Is this an unrecognized option or missing argument? */
+    bool error() const noexcept
+    {
+	return name.empty() && id != 1;
+    }
+};
+
+class parser {
+public:
+    class iterator {
+    public:
+	typedef std::input_iterator_tag iterator_category;
+	typedef item value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef const item *pointer;
+	typedef const item &reference;
+
+	iterator() noexcept : parser_(nullptr) {}
+
+	reference operator*() const noexcept { return parser_->current_; }
+	pointer operator->() const noexcept { return &parser_->current_; }
+
+	iterator &operator++() noexcept
+	{
+	    if (!parser_->next())
+		parser_ = nullptr;
+	    return *this;
+	}
+
+	/* Input iterator post-increment, the result can only be compared */
+	iterator operator++(int) noexcept
+	{
+	    iterator prev(*this);
+	    ++*this;
+	    return prev;
+	}
+
+	friend bool operator==(const iterator &a, const iterator &b) noexcept
+	{
+	    return a.parser_ == b.parser_;
+	}
+
+	friend bool operator!=(const iterator &a, const iterator &b) noexcept
+	{
+	    return a.parser_ != b.parser_;
+	}
+
+    private:
+	friend class parser;
+
+	explicit iterator(parser *p) noexcept : parser_(p) {}
+
+	parser *parser_;
+    };
+
+    /* Parse as ultragetopt_long() */
+    parser(int argc, char *const argv[], const char *shortopts,
+	   const struct option *longopts = nullptr) noexcept
+	: argc_(argc), argv_(argv), shortopts_(shortopts),
+	  longopts_(longopts), table_(nullptr), started_(false), done_(false)
+    {
+	ultragetopt_state_init(&state_);
+    }
+
+    /* Parse as ultragetopt_long_table() */
+    parser(int argc, char *const argv[],
+	   const struct ultragetopt_table &table) noexcept
+	: argc_(argc), argv_(argv), shortopts_(nullptr), longopts_(nullptr),
+	  table_(&table), started_(false), done_(false)
+    {
+	ultragetopt_state_init(&state_);
+    }
+
+    /* Parse the first option, if not already started */
+    iterator begin() noexcept
+    {
+	if (!started_) {
+	    started_ = true;
+	    if (!next())
+		return end();
+	} else if (done_)
+	    return end();
+
+	return iterator(this);
+    }
+
+    iterator end() noexcept { return iterator(); }
+
+    /* Index of the next argv element to parse (once iteration is complete,
+     * the first non-option argument) */
+    int optind() const noexcept { return state_.optind; }
+
+    /* Option character of the last error, as ultraoptopt */
+    int optopt() const noexcept { return state_.optopt; }
+
+    /* Print error messages?  (as ultraopterr, default true) */
+    void opterr(bool print) noexcept { state_.opterr = print; }
+
+    /* Record occurrences of each option (as ultraoptoccur) */
+    void occurrences(struct ultragetopt_occurrences *occ) noexcept
+    {
+	state_.occurrences = occ;
+    }
+
+private:
+    /* Parse the next option into current_, returns false at the end */
+    bool next() noexcept
+    {
+	int id;
+
+	if (table_ != nullptr)
+	    id = ultragetopt_long_table_r(&state_, argc_, argv_, table_,
+					  nullptr);
+	else
+	    id = ultragetopt_long_r(&state_, argc_, argv_, shortopts_,
+				    longopts_, nullptr);
+
+	done_ = id == -1;
+	if (done_)
+	    return false;
+
+	current_.id = id;
+	current_.longind = state_.longind;
+	current_.index = state_.curind;
+	if (state_.optname == nullptr)
+	    current_.name = std::string_view();
+	else if (state_.longind >= 0)
+	    current_.name = std::string_view(state_.optname);
+	else
+	    current_.name = std::string_view(state_.optname, 1);
+
+	if (state_.optarg != nullptr)
+	    current_.arg = std::string_view(state_.optarg);
+	else
+	    current_.arg.reset();
+
+	return true;
+    }
+
+    int argc_;
+    char *const *argv_;
+    const char *shortopts_;
+    const struct option *longopts_;
+    const struct ultragetopt_table *table_;
+    struct ultragetopt_state state_;
+    item current_;
+    bool started_;
+    bool done_;
+};
+
+} /* namespace ugo */
+
+#endif /* INCLUDED_ULTRAGETOPT_HPP */